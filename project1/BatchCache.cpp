@@ -0,0 +1,35 @@
+#include "BatchCache.hpp"
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+void BatchCache::clear()
+// Drop all results
+{
+    scoped_lock lock(mutex);
+    entries.clear();
+}
+//---------------------------------------------------------------------------
+string BatchCache::canonicalFilters(RelationId relId, unsigned binding,
+                                    const vector<FilterInfo>& filters)
+// The canonical form of the filters of a binding on a relation
+{
+    // The order and duplicates of the filters do not matter
+    vector<tuple<unsigned, char, uint64_t>> canonical;
+    for (auto& f : filters)
+        if (f.filterColumn.binding == binding)
+            canonical.emplace_back(f.filterColumn.colId, f.comparison,
+                                   f.constant);
+    sort(canonical.begin(), canonical.end());
+    canonical.erase(unique(canonical.begin(), canonical.end()),
+                    canonical.end());
+
+    stringstream out;
+    out << "r" << relId;
+    for (auto& [colId, comparison, constant] : canonical)
+        out << " c" << colId << comparison << constant;
+    return out.str();
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,36 @@
+#include "BloomFilter.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+BloomFilter::BloomFilter(uint64_t numKeys)
+// Constructor
+{
+    // At least two words, a shift by 64 would be undefined
+    unsigned wordBits = 1;
+    while ((64ull << wordBits) < numKeys * bitsPerKey)
+        ++wordBits;
+    shift = 64 - wordBits;
+    words.assign(1ull << wordBits, 0);
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+unsigned BloomFilter::filter(const ColumnView& keys, RowId* selection,
+                             unsigned count) const
+// Keep the row ids whose key is possibly contained
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        // Branch-free, selection[n] is overwritten when the key is rejected
+        selection[n] = selection[i];
+        n += contains(keys.value(selection[i]));
+    }
+    return n;
+}
+//---------------------------------------------------------------------------
+template unsigned BloomFilter::filter(const ColumnView&, uint32_t*,
+                                      unsigned) const;
+template unsigned BloomFilter::filter(const ColumnView&, uint64_t*,
+                                      unsigned) const;
+//---------------------------------------------------------------------------
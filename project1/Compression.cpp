@@ -0,0 +1,234 @@
+#include "Compression.hpp"
+#include <algorithm>
+#include "Parser.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+static unsigned codeWidth(uint64_t maxCode)
+// The smallest code size (in bytes) that holds all codes up to maxCode
+{
+    if (maxCode <= UINT8_MAX)
+        return 1;
+    if (maxCode <= UINT16_MAX)
+        return 2;
+    if (maxCode <= UINT32_MAX)
+        return 4;
+    return 8;
+}
+//---------------------------------------------------------------------------
+template <typename Code, typename Encode>
+static void encode(const uint64_t* column, uint64_t size, Code* codes,
+                   Encode&& f)
+// Store the code of every value
+{
+    BlockInfo bi(0, size);
+    parallel_for(bi, [&](unsigned, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+            codes[i] = f(column[i]);
+    });
+}
+//---------------------------------------------------------------------------
+template <typename Encode>
+static void encode(const uint64_t* column, uint64_t size, unsigned width,
+                   void* codes, Encode&& f)
+// Store the code of every value in codes of the given size
+{
+    switch (width)
+    {
+        case 1:
+            return encode(column, size, static_cast<uint8_t*>(codes), f);
+        case 2:
+            return encode(column, size, static_cast<uint16_t*>(codes), f);
+        default:
+            return encode(column, size, static_cast<uint32_t*>(codes), f);
+    }
+}
+//---------------------------------------------------------------------------
+CompressedColumn CompressedColumn::compress(const uint64_t* column,
+                                            uint64_t size,
+                                            const ColumnStatistics& stats)
+// Compress a column
+{
+    CompressedColumn result;
+    if (size == 0)
+        return result;
+    result.size = size;
+
+    result.encoding = Encoding::FrameOfReference;
+    result.base = stats.min;
+    result.maxCode = stats.max - stats.min;
+
+    // A dictionary only pays off if it gives narrower codes, the distinct
+    // count is an estimate, so the dictionary may still turn out too large
+    if (codeWidth(result.maxCode) > codeWidth(stats.distinct - 1) &&
+        stats.distinct <= maxDictionarySize)
+    {
+        vector<uint64_t> values(column, column + size);
+        sort(values.begin(), values.end());
+        values.erase(unique(values.begin(), values.end()), values.end());
+        if (values.size() <= maxDictionarySize &&
+            codeWidth(values.size() - 1) < codeWidth(result.maxCode))
+        {
+            result.encoding = Encoding::Dictionary;
+            result.maxCode = values.size() - 1;
+            result.dictionary = move(values);
+        }
+    }
+
+    result.width = codeWidth(result.maxCode);
+    if (result.width == sizeof(uint64_t))
+        return CompressedColumn();
+
+    result.storage.resize(result.codesLength() / sizeof(uint64_t));
+    result.data = result.storage.data();
+    if (result.encoding == Encoding::Dictionary)
+    {
+        auto& dictionary = result.dictionary;
+        encode(column, size, result.width, result.storage.data(),
+               [&dictionary](uint64_t value) {
+                   return lower_bound(dictionary.begin(), dictionary.end(),
+                                      value) -
+                          dictionary.begin();
+               });
+    }
+    else
+    {
+        const uint64_t base = result.base;
+        encode(column, size, result.width, result.storage.data(),
+               [base](uint64_t value) { return value - base; });
+    }
+    return result;
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+static void decode(const CompressedColumn& column, const Code* codes,
+                   uint64_t count, uint64_t* values)
+// Decompress count codes
+{
+    if (column.encoding == CompressedColumn::Encoding::Dictionary)
+    {
+        const uint64_t* dictionary = column.dictionary.data();
+        for (uint64_t i = 0; i < count; ++i)
+            values[i] = dictionary[codes[i]];
+    }
+    else
+    {
+        for (uint64_t i = 0; i < count; ++i)
+            values[i] = column.base + codes[i];
+    }
+}
+//---------------------------------------------------------------------------
+void CompressedColumn::decode(uint64_t i, uint64_t count,
+                              uint64_t* values) const
+// Decompress count values from the i-th value on
+{
+    switch (width)
+    {
+        case 1:
+            return ::decode(
+                *this, reinterpret_cast<const uint8_t*>(codes()) + i, count,
+                values);
+        case 2:
+            return ::decode(
+                *this, reinterpret_cast<const uint16_t*>(codes()) + i, count,
+                values);
+        default:
+            return ::decode(
+                *this, reinterpret_cast<const uint32_t*>(codes()) + i, count,
+                values);
+    }
+}
+//---------------------------------------------------------------------------
+template <typename Code, typename RowId>
+static void gather(const CompressedColumn& column, const Code* codes,
+                   const RowId* rowIds, uint64_t count, uint64_t* values)
+// Decompress the codes of count rows
+{
+    if (column.encoding == CompressedColumn::Encoding::Dictionary)
+    {
+        const uint64_t* dictionary = column.dictionary.data();
+        for (uint64_t i = 0; i < count; ++i)
+            values[i] = dictionary[codes[rowIds[i]]];
+    }
+    else
+    {
+        for (uint64_t i = 0; i < count; ++i)
+            values[i] = column.base + codes[rowIds[i]];
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void CompressedColumn::gather(const RowId* rowIds, uint64_t count,
+                              uint64_t* values) const
+// Decompress the values of count rows
+{
+    switch (width)
+    {
+        case 1:
+            return ::gather(*this, reinterpret_cast<const uint8_t*>(codes()),
+                            rowIds, count, values);
+        case 2:
+            return ::gather(*this, reinterpret_cast<const uint16_t*>(codes()),
+                            rowIds, count, values);
+        default:
+            return ::gather(*this, reinterpret_cast<const uint32_t*>(codes()),
+                            rowIds, count, values);
+    }
+}
+//---------------------------------------------------------------------------
+template void CompressedColumn::gather(const uint32_t*, uint64_t,
+                                       uint64_t*) const;
+template void CompressedColumn::gather(const uint64_t*, uint64_t,
+                                       uint64_t*) const;
+//---------------------------------------------------------------------------
+bool CompressedColumn::translate(const FilterInfo& f, uint64_t& low,
+                                 uint64_t& high) const
+// Translate a filter into a range of codes
+{
+    const uint64_t constant = f.constant;
+    if (encoding == Encoding::Dictionary)
+    {
+        auto first = lower_bound(dictionary.begin(), dictionary.end(),
+                                 constant);
+        const uint64_t position = first - dictionary.begin();
+        switch (f.comparison)
+        {
+            case FilterInfo::Comparison::Less:
+                low = 0;
+                high = position - 1;
+                return position > 0;
+            case FilterInfo::Comparison::Greater:
+                low = position + (first != dictionary.end() &&
+                                  *first == constant);
+                high = maxCode;
+                return low <= maxCode;
+            default:
+                low = high = position;
+                return first != dictionary.end() && *first == constant;
+        }
+    }
+
+    // The values of the codes are base to base + maxCode
+    switch (f.comparison)
+    {
+        case FilterInfo::Comparison::Less:
+            low = 0;
+            high = min(constant - base - 1, maxCode);
+            return constant > base;
+        case FilterInfo::Comparison::Greater:
+            low = constant < base ? 0 : constant - base + 1;
+            high = maxCode;
+            return constant < base || constant - base < maxCode;
+        default:
+            low = high = constant - base;
+            return constant >= base && constant - base <= maxCode;
+    }
+}
+//---------------------------------------------------------------------------
+uint64_t CompressedColumn::memoryUsage() const
+// The number of bytes used by the codes and the dictionary
+{
+    return codesLength() + dictionary.size() * sizeof(uint64_t);
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,577 @@
+#include "FilterKernels.hpp"
+#include <array>
+#include <cassert>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+//---------------------------------------------------------------------------
+using namespace std;
+using Comparison = FilterInfo::Comparison;
+//---------------------------------------------------------------------------
+template <Comparison comparison>
+static inline bool compare(uint64_t value, uint64_t constant)
+// Compare a single value
+{
+    switch (comparison)
+    {
+        case Comparison::Equal:
+            return value == constant;
+        case Comparison::Greater:
+            return value > constant;
+        case Comparison::Less:
+            return value < constant;
+    }
+    return false;
+}
+//---------------------------------------------------------------------------
+template <Comparison comparison>
+static inline uint64_t evaluateTail(const uint64_t* column, unsigned begin,
+                                    unsigned end, uint64_t constant)
+// Evaluate the values [begin, end) of a 64 value word
+{
+    uint64_t bits = 0;
+    for (unsigned j = begin; j < end; ++j)
+        bits |= uint64_t(compare<comparison>(column[j], constant)) << j;
+    return bits;
+}
+//---------------------------------------------------------------------------
+template <Comparison comparison>
+static void evaluateScalar(const uint64_t* column, uint64_t count,
+                           uint64_t constant, uint64_t* mask, bool combine)
+// Evaluate a comparison, one value at a time
+{
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        const unsigned limit = min<uint64_t>(64, count - w * 64);
+        uint64_t bits =
+            evaluateTail<comparison>(column + w * 64, 0, limit, constant);
+        mask[w] = combine ? mask[w] & bits : bits;
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+static unsigned compactScalar(const uint64_t* mask, uint64_t count,
+                              uint64_t firstId, RowId* selection)
+// Compact the set bits, one at a time
+{
+    unsigned n = 0;
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        for (uint64_t bits = mask[w]; bits; bits &= bits - 1)
+            selection[n++] = firstId + w * 64 + __builtin_ctzll(bits);
+    }
+    return n;
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+static inline uint64_t evaluateCodesTail(const Code* codes, unsigned begin,
+                                         unsigned end, uint64_t low,
+                                         uint64_t range)
+// Evaluate the codes [begin, end) of a 64 code word
+{
+    uint64_t bits = 0;
+    for (unsigned j = begin; j < end; ++j)
+        bits |= uint64_t(codes[j] - low <= range) << j;
+    return bits;
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+static void evaluateCodesScalar(const Code* codes, uint64_t count,
+                                uint64_t low, uint64_t range, uint64_t* mask,
+                                bool combine)
+// Evaluate a code range, one code at a time
+{
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        const unsigned limit = min<uint64_t>(64, count - w * 64);
+        uint64_t bits =
+            evaluateCodesTail(codes + w * 64, 0, limit, low, range);
+        mask[w] = combine ? mask[w] & bits : bits;
+    }
+}
+//---------------------------------------------------------------------------
+#if defined(__x86_64__)
+template <Comparison comparison>
+__attribute__((target("avx2"))) static void evaluateAVX2(
+    const uint64_t* column, uint64_t count, uint64_t constant, uint64_t* mask,
+    bool combine)
+// Evaluate a comparison, four values at a time
+{
+    // There is no unsigned 64 bit comparison, so the sign bits are flipped
+    const __m256i signBit = _mm256_set1_epi64x(1ull << 63);
+    const __m256i c = _mm256_set1_epi64x(constant);
+    const __m256i flippedC = _mm256_xor_si256(c, signBit);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        const uint64_t* words = column + w * 64;
+        const unsigned limit = min<uint64_t>(64, count - w * 64);
+        uint64_t bits = 0;
+        unsigned j = 0;
+        for (; j + 4 <= limit; j += 4)
+        {
+            __m256i v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(words + j));
+            __m256i m;
+            switch (comparison)
+            {
+                case Comparison::Equal:
+                    m = _mm256_cmpeq_epi64(v, c);
+                    break;
+                case Comparison::Greater:
+                    m = _mm256_cmpgt_epi64(_mm256_xor_si256(v, signBit),
+                                           flippedC);
+                    break;
+                case Comparison::Less:
+                    m = _mm256_cmpgt_epi64(flippedC,
+                                           _mm256_xor_si256(v, signBit));
+                    break;
+            }
+            bits |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(m))) << j;
+        }
+        bits |= evaluateTail<comparison>(words, j, limit, constant);
+        mask[w] = combine ? mask[w] & bits : bits;
+    }
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+__attribute__((target("avx2"))) static inline __m256i broadcastAVX2(
+    uint64_t value)
+// Broadcast a code to all lanes
+{
+    if constexpr (sizeof(Code) == 1)
+        return _mm256_set1_epi8(char(value));
+    else if constexpr (sizeof(Code) == 2)
+        return _mm256_set1_epi16(short(value));
+    else
+        return _mm256_set1_epi32(int(value));
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+__attribute__((target("avx2"))) static inline uint64_t evaluateCodesAVX2(
+    const Code* codes, __m256i low, __m256i range)
+// Evaluate the codes of one vector, code - low <= range is computed as
+// min(code - low, range) == code - low (there are no unsigned comparisons)
+{
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(codes));
+    if constexpr (sizeof(Code) == 1)
+    {
+        const __m256i x = _mm256_sub_epi8(v, low);
+        const __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(x, range), x);
+        return uint32_t(_mm256_movemask_epi8(m));
+    }
+    else if constexpr (sizeof(Code) == 2)
+    {
+        // Narrow the 16 bit lanes to bytes for the movemask
+        const __m256i x = _mm256_sub_epi16(v, low);
+        const __m256i m = _mm256_cmpeq_epi16(_mm256_min_epu16(x, range), x);
+        const __m256i bytes = _mm256_permute4x64_epi64(
+            _mm256_packs_epi16(m, _mm256_setzero_si256()), 0xd8);
+        return uint32_t(_mm256_movemask_epi8(bytes));
+    }
+    else
+    {
+        const __m256i x = _mm256_sub_epi32(v, low);
+        const __m256i m = _mm256_cmpeq_epi32(_mm256_min_epu32(x, range), x);
+        return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+    }
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+__attribute__((target("avx2"))) static void evaluateCodesAVX2(
+    const Code* codes, uint64_t count, uint64_t low, uint64_t range,
+    uint64_t* mask, bool combine)
+// Evaluate a code range, 32 / sizeof(Code) codes at a time
+{
+    constexpr unsigned lanes = 32 / sizeof(Code);
+    const __m256i lowV = broadcastAVX2<Code>(low);
+    const __m256i rangeV = broadcastAVX2<Code>(range);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        const Code* words = codes + w * 64;
+        const unsigned limit = min<uint64_t>(64, count - w * 64);
+        uint64_t bits = 0;
+        unsigned j = 0;
+        for (; j + lanes <= limit; j += lanes)
+            bits |= evaluateCodesAVX2(words + j, lowV, rangeV) << j;
+        bits |= evaluateCodesTail(words, j, limit, low, range);
+        mask[w] = combine ? mask[w] & bits : bits;
+    }
+}
+//---------------------------------------------------------------------------
+/// Permutations that move the selected 64 bit lanes of a 4 bit mask to the
+/// front (as indexes of 32 bit lanes)
+static const array<array<int32_t, 8>, 16> compactPermutations = [] {
+    array<array<int32_t, 8>, 16> permutations{};
+    for (unsigned m = 0; m < 16; ++m)
+    {
+        unsigned k = 0;
+        for (unsigned lane = 0; lane < 4; ++lane)
+        {
+            if (m & (1u << lane))
+            {
+                permutations[m][2 * k] = 2 * lane;
+                permutations[m][2 * k + 1] = 2 * lane + 1;
+                ++k;
+            }
+        }
+    }
+    return permutations;
+}();
+//---------------------------------------------------------------------------
+/// Permutations that move the selected 32 bit lanes of an 8 bit mask to the
+/// front
+static const array<array<int32_t, 8>, 256> compactPermutations32 = [] {
+    array<array<int32_t, 8>, 256> permutations{};
+    for (unsigned m = 0; m < 256; ++m)
+    {
+        unsigned k = 0;
+        for (unsigned lane = 0; lane < 8; ++lane)
+            if (m & (1u << lane))
+                permutations[m][k++] = lane;
+    }
+    return permutations;
+}();
+//---------------------------------------------------------------------------
+__attribute__((target("avx2"))) static unsigned compactAVX2(
+    const uint64_t* mask, uint64_t count, uint64_t firstId,
+    uint64_t* selection)
+// Compact the set bits, four at a time
+{
+    unsigned n = 0;
+    const __m256i step = _mm256_set1_epi64x(4);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        uint64_t bits = mask[w];
+        if (!bits)
+            continue;
+        __m256i ids = _mm256_add_epi64(_mm256_set1_epi64x(firstId + w * 64),
+                                       _mm256_set_epi64x(3, 2, 1, 0));
+        for (unsigned j = 0; j < 64; j += 4, bits >>= 4)
+        {
+            const unsigned m = bits & 0xf;
+            const __m256i permutation =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                    compactPermutations[m].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(selection + n),
+                                _mm256_permutevar8x32_epi32(ids, permutation));
+            n += __builtin_popcount(m);
+            ids = _mm256_add_epi64(ids, step);
+        }
+    }
+    return n;
+}
+//---------------------------------------------------------------------------
+__attribute__((target("avx2"))) static unsigned compactAVX2(
+    const uint64_t* mask, uint64_t count, uint64_t firstId,
+    uint32_t* selection)
+// Compact the set bits into 32 bit ids, eight at a time
+{
+    unsigned n = 0;
+    const __m256i step = _mm256_set1_epi32(8);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        uint64_t bits = mask[w];
+        if (!bits)
+            continue;
+        __m256i ids = _mm256_add_epi32(
+            _mm256_set1_epi32(uint32_t(firstId + w * 64)),
+            _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        for (unsigned j = 0; j < 64; j += 8, bits >>= 8)
+        {
+            const unsigned m = bits & 0xff;
+            const __m256i permutation =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                    compactPermutations32[m].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(selection + n),
+                                _mm256_permutevar8x32_epi32(ids, permutation));
+            n += __builtin_popcount(m);
+            ids = _mm256_add_epi32(ids, step);
+        }
+    }
+    return n;
+}
+//---------------------------------------------------------------------------
+template <Comparison comparison>
+__attribute__((target("avx512f"))) static void evaluateAVX512(
+    const uint64_t* column, uint64_t count, uint64_t constant, uint64_t* mask,
+    bool combine)
+// Evaluate a comparison, eight values at a time
+{
+    const __m512i c = _mm512_set1_epi64(constant);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        const uint64_t* words = column + w * 64;
+        const unsigned limit = min<uint64_t>(64, count - w * 64);
+        uint64_t bits = 0;
+        unsigned j = 0;
+        for (; j + 8 <= limit; j += 8)
+        {
+            __m512i v = _mm512_loadu_si512(words + j);
+            __mmask8 m = 0;
+            switch (comparison)
+            {
+                case Comparison::Equal:
+                    m = _mm512_cmpeq_epu64_mask(v, c);
+                    break;
+                case Comparison::Greater:
+                    m = _mm512_cmpgt_epu64_mask(v, c);
+                    break;
+                case Comparison::Less:
+                    m = _mm512_cmplt_epu64_mask(v, c);
+                    break;
+            }
+            bits |= uint64_t(m) << j;
+        }
+        bits |= evaluateTail<comparison>(words, j, limit, constant);
+        mask[w] = combine ? mask[w] & bits : bits;
+    }
+}
+//---------------------------------------------------------------------------
+__attribute__((target("avx512f"))) static unsigned compactAVX512(
+    const uint64_t* mask, uint64_t count, uint64_t firstId,
+    uint64_t* selection)
+// Compact the set bits, eight at a time
+{
+    unsigned n = 0;
+    const __m512i step = _mm512_set1_epi64(8);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        uint64_t bits = mask[w];
+        if (!bits)
+            continue;
+        __m512i ids =
+            _mm512_add_epi64(_mm512_set1_epi64(firstId + w * 64),
+                             _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0));
+        for (unsigned j = 0; j < 64; j += 8, bits >>= 8)
+        {
+            const __mmask8 m = bits & 0xff;
+            _mm512_mask_compressstoreu_epi64(selection + n, m, ids);
+            n += __builtin_popcount(m);
+            ids = _mm512_add_epi64(ids, step);
+        }
+    }
+    return n;
+}
+//---------------------------------------------------------------------------
+__attribute__((target("avx512f"))) static unsigned compactAVX512(
+    const uint64_t* mask, uint64_t count, uint64_t firstId,
+    uint32_t* selection)
+// Compact the set bits into 32 bit ids, sixteen at a time
+{
+    unsigned n = 0;
+    const __m512i step = _mm512_set1_epi32(16);
+    for (uint64_t w = 0; w * 64 < count; ++w)
+    {
+        uint64_t bits = mask[w];
+        if (!bits)
+            continue;
+        __m512i ids = _mm512_add_epi32(
+            _mm512_set1_epi32(uint32_t(firstId + w * 64)),
+            _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+                             1, 0));
+        for (unsigned j = 0; j < 64; j += 16, bits >>= 16)
+        {
+            const __mmask16 m = bits & 0xffff;
+            _mm512_mask_compressstoreu_epi32(selection + n, m, ids);
+            n += __builtin_popcount(m);
+            ids = _mm512_add_epi32(ids, step);
+        }
+    }
+    return n;
+}
+#endif
+//---------------------------------------------------------------------------
+ZoneMap::Match FilterKernels::matchZone(const ZoneMap& zoneMap,
+                                       uint64_t zone, const FilterInfo& f)
+// Match the values of a zone against a filter
+{
+    switch (f.comparison)
+    {
+        case Comparison::Equal:
+            return zoneMap.matchEqual(zone, f.constant);
+        case Comparison::Greater:
+            return zoneMap.matchGreater(zone, f.constant);
+        case Comparison::Less:
+            return zoneMap.matchLess(zone, f.constant);
+    }
+    return ZoneMap::Match::Some;
+}
+//---------------------------------------------------------------------------
+FilterKernels::Isa FilterKernels::best()
+// The best instruction set supported by the CPU
+{
+#if defined(__x86_64__)
+    static const Isa isa = __builtin_cpu_supports("avx512f")
+                               ? Isa::AVX512
+                               : __builtin_cpu_supports("avx2") ? Isa::AVX2
+                                                                : Isa::Scalar;
+    return isa;
+#else
+    return Isa::Scalar;
+#endif
+}
+//---------------------------------------------------------------------------
+template <Comparison comparison>
+static void evaluate(FilterKernels::Isa isa, const uint64_t* column,
+                     uint64_t count, uint64_t constant, uint64_t* mask,
+                     bool combine)
+// Dispatch a comparison to the kernel of an instruction set
+{
+    switch (isa)
+    {
+#if defined(__x86_64__)
+        case FilterKernels::Isa::AVX512:
+            return evaluateAVX512<comparison>(column, count, constant, mask,
+                                              combine);
+        case FilterKernels::Isa::AVX2:
+            return evaluateAVX2<comparison>(column, count, constant, mask,
+                                            combine);
+#endif
+        default:
+            return evaluateScalar<comparison>(column, count, constant, mask,
+                                              combine);
+    }
+}
+//---------------------------------------------------------------------------
+void FilterKernels::evaluate(Isa isa, const uint64_t* column, uint64_t count,
+                             Comparison comparison, uint64_t constant,
+                             uint64_t* mask, bool combine)
+// Compare count values with a constant
+{
+    switch (comparison)
+    {
+        case Comparison::Equal:
+            return ::evaluate<Comparison::Equal>(isa, column, count, constant,
+                                                 mask, combine);
+        case Comparison::Greater:
+            return ::evaluate<Comparison::Greater>(isa, column, count,
+                                                   constant, mask, combine);
+        case Comparison::Less:
+            return ::evaluate<Comparison::Less>(isa, column, count, constant,
+                                                mask, combine);
+    }
+}
+//---------------------------------------------------------------------------
+template <typename Code>
+static void evaluateCodes(FilterKernels::Isa isa, const Code* codes,
+                          uint64_t count, uint64_t low, uint64_t range,
+                          uint64_t* mask, bool combine)
+// Dispatch a code range to the kernel of an instruction set
+{
+#if defined(__x86_64__)
+    // The codes fill the AVX2 lanes well enough, AVX-512 uses them as well
+    if (isa != FilterKernels::Isa::Scalar)
+        return evaluateCodesAVX2(codes, count, low, range, mask, combine);
+#endif
+    return evaluateCodesScalar(codes, count, low, range, mask, combine);
+}
+//---------------------------------------------------------------------------
+void FilterKernels::evaluateCodes(Isa isa, const CompressedColumn& column,
+                                  uint64_t begin, uint64_t count,
+                                  uint64_t low, uint64_t high, uint64_t* mask,
+                                  bool combine)
+// Check whether the codes of count values are in [low, high]
+{
+    const uint64_t range = high - low;
+    switch (column.width)
+    {
+        case 1:
+            return ::evaluateCodes(
+                isa, static_cast<const uint8_t*>(column.codes()) + begin,
+                count, low, range, mask, combine);
+        case 2:
+            return ::evaluateCodes(
+                isa, static_cast<const uint16_t*>(column.codes()) + begin,
+                count, low, range, mask, combine);
+        default:
+            return ::evaluateCodes(
+                isa, static_cast<const uint32_t*>(column.codes()) + begin,
+                count, low, range, mask, combine);
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+unsigned FilterKernels::compact(Isa isa, const uint64_t* mask, uint64_t count,
+                                uint64_t firstId, RowId* selection)
+// Compact the set bits of a mask into a selection vector
+{
+    switch (isa)
+    {
+#if defined(__x86_64__)
+        case Isa::AVX512:
+            return compactAVX512(mask, count, firstId, selection);
+        case Isa::AVX2:
+            return compactAVX2(mask, count, firstId, selection);
+#endif
+        default:
+            return compactScalar(mask, count, firstId, selection);
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+unsigned FilterKernels::select(Relation& relation,
+                               const vector<FilterInfo>& filters,
+                               uint64_t begin, uint64_t end,
+                               RowId* selection, Isa isa)
+// Select the row ids in [begin, end) that pass all filters
+{
+    assert(end - begin <= blockSize);
+    const uint64_t count = end - begin;
+    uint64_t mask[blockSize / 64];
+
+    // The zone map decides a filter for all rows of a block inside one zone
+    const uint64_t zone = begin / ZoneMap::zoneSize;
+    const bool useZoneMaps = !relation.zoneMaps.empty() &&
+                             (end - 1) / ZoneMap::zoneSize == zone;
+
+    bool combine = false;
+    for (auto& f : filters)
+    {
+        auto match = ZoneMap::Match::Some;
+        if (useZoneMaps)
+            match = matchZone(relation.zoneMaps[f.filterColumn.colId], zone, f);
+        if (match == ZoneMap::Match::None)
+            return 0;
+        if (match == ZoneMap::Match::All)
+            continue;
+
+        // Compressed columns are filtered on their codes
+        const unsigned colId = f.filterColumn.colId;
+        if (!relation.compressed.empty() &&
+            relation.compressed[colId].encoding !=
+                CompressedColumn::Encoding::None)
+        {
+            uint64_t low, high;
+            if (!relation.compressed[colId].translate(f, low, high))
+                return 0;
+            evaluateCodes(isa, relation.compressed[colId], begin, count, low,
+                          high, mask, combine);
+        }
+        else
+        {
+            evaluate(isa, relation.columns[colId] + begin, count,
+                     f.comparison, f.constant, mask, combine);
+        }
+        combine = true;
+    }
+
+    // All rows pass
+    if (!combine)
+    {
+        for (uint64_t w = 0; w * 64 < count; ++w)
+            mask[w] = count - w * 64 >= 64 ? ~0ull
+                                           : (1ull << (count - w * 64)) - 1;
+    }
+    return compact(isa, mask, count, begin, selection);
+}
+//---------------------------------------------------------------------------
+template unsigned FilterKernels::compact(Isa, const uint64_t*, uint64_t,
+                                         uint64_t, uint32_t*);
+template unsigned FilterKernels::compact(Isa, const uint64_t*, uint64_t,
+                                         uint64_t, uint64_t*);
+template unsigned FilterKernels::select(Relation&, const vector<FilterInfo>&,
+                                        uint64_t, uint64_t, uint32_t*, Isa);
+template unsigned FilterKernels::select(Relation&, const vector<FilterInfo>&,
+                                        uint64_t, uint64_t, uint64_t*, Isa);
+//---------------------------------------------------------------------------
@@ -0,0 +1,197 @@
+#include "Index.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "Parser.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// A value and the row it belongs to
+struct IndexEntry
+{
+    uint64_t key;
+    uint64_t rowId;
+
+    bool operator<(const IndexEntry& other) const
+    {
+        return key < other.key || (key == other.key && rowId < other.rowId);
+    }
+};
+/// The header of a sidecar file, followed by the keys and the row ids
+struct IndexFileHeader
+{
+    /// Identifies index files
+    static constexpr uint64_t magic = 0x3158444954524f53ull;  // "SORTIDX1"
+
+    uint64_t fileMagic;
+    /// The number of entries
+    uint64_t size;
+    /// The version of the indexed data
+    uint64_t stamp;
+};
+//---------------------------------------------------------------------------
+SortedIndex SortedIndex::build(const uint64_t* column, uint64_t size)
+// Build the index of a column
+{
+    vector<IndexEntry> entries(size);
+
+    // Every block sorts its entries
+    BlockInfo bi(0, size);
+    parallel_for(bi, [column, &entries](unsigned, uint64_t begin,
+                                        uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+            entries[i] = IndexEntry{ column[i], i };
+        sort(entries.begin() + begin, entries.begin() + end);
+    });
+
+    // The sorted runs are merged pairwise, the merges of a round in parallel
+    vector<uint64_t> runs;
+    for (unsigned b = 0; b < bi.blockCount; ++b)
+        runs.push_back(bi.begin + uint64_t(b) * bi.blockSize);
+    runs.push_back(size);
+    while (runs.size() > 2)
+    {
+        const unsigned numMerges = (runs.size() - 1) / 2;
+        parallel_for(BlockInfo(0, numMerges, 1),
+                     [&entries, &runs](unsigned, uint64_t begin,
+                                       uint64_t end) {
+                         for (uint64_t m = begin; m < end; ++m)
+                             inplace_merge(entries.begin() + runs[2 * m],
+                                           entries.begin() + runs[2 * m + 1],
+                                           entries.begin() + runs[2 * m + 2]);
+                     });
+        vector<uint64_t> merged;
+        for (uint64_t r = 0; r < runs.size() - 1; r += 2)
+            merged.push_back(runs[r]);
+        merged.push_back(size);
+        runs = move(merged);
+    }
+
+    SortedIndex index;
+    index.count = size;
+    index.storage.resize(2 * size);
+    uint64_t* keys = index.storage.data();
+    uint64_t* rowIds = keys + size;
+    parallel_for(bi, [&entries, keys, rowIds](unsigned, uint64_t begin,
+                                              uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            keys[i] = entries[i].key;
+            rowIds[i] = entries[i].rowId;
+        }
+    });
+    index.keys = keys;
+    index.rowIds = rowIds;
+    return index;
+}
+//---------------------------------------------------------------------------
+pair<uint64_t, uint64_t> SortedIndex::equalRange(uint64_t key) const
+// The positions [first, last) of the entries with the key
+{
+    auto range = equal_range(keys, keys + count, key);
+    return { range.first - keys, range.second - keys };
+}
+//---------------------------------------------------------------------------
+pair<uint64_t, uint64_t> SortedIndex::filterRange(const FilterInfo& f) const
+// The positions [first, last) of the entries that pass a filter
+{
+    switch (f.comparison)
+    {
+        case FilterInfo::Comparison::Less:
+            return { 0, lower_bound(keys, keys + count, f.constant) - keys };
+        case FilterInfo::Comparison::Greater:
+            return { upper_bound(keys, keys + count, f.constant) - keys,
+                     count };
+        default:
+            return equalRange(f.constant);
+    }
+}
+//---------------------------------------------------------------------------
+bool SortedIndex::load(const string& fileName, uint64_t size, uint64_t stamp,
+                       SortedIndex& index)
+// Map the index from a sidecar file
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat sb;
+    const uint64_t length =
+        sizeof(IndexFileHeader) + 2 * size * sizeof(uint64_t);
+    if (fstat(fd, &sb) == -1 || uint64_t(sb.st_size) != length)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0u);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    auto header = static_cast<const IndexFileHeader*>(addr);
+    if (header->fileMagic != IndexFileHeader::magic || header->size != size ||
+        header->stamp != stamp)
+    {
+        munmap(addr, length);
+        return false;
+    }
+
+    index = SortedIndex();
+    index.count = size;
+    index.mapping = addr;
+    index.mappingLength = length;
+    index.keys = reinterpret_cast<const uint64_t*>(header + 1);
+    index.rowIds = index.keys + size;
+    return true;
+}
+//---------------------------------------------------------------------------
+bool SortedIndex::store(const string& fileName, uint64_t stamp) const
+// Store the index into a sidecar file
+{
+    // The file is renamed when it is complete, so a crash never leaves a
+    // partial index behind
+    const string tmpFileName = fileName + ".tmp";
+    ofstream outFile;
+    outFile.open(tmpFileName, ios::out | ios::binary);
+    IndexFileHeader header{ IndexFileHeader::magic, count, stamp };
+    outFile.write((char*)&header, sizeof(header));
+    outFile.write((char*)keys, count * sizeof(uint64_t));
+    outFile.write((char*)rowIds, count * sizeof(uint64_t));
+    outFile.close();
+    if (!outFile)
+    {
+        remove(tmpFileName.c_str());
+        return false;
+    }
+    return rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+}
+//---------------------------------------------------------------------------
+SortedIndex& SortedIndex::operator=(SortedIndex&& other) noexcept
+// Move assignment
+{
+    if (this == &other)
+        return *this;
+    if (mapping)
+        munmap(mapping, mappingLength);
+    count = exchange(other.count, 0);
+    storage = move(other.storage);
+    mapping = exchange(other.mapping, nullptr);
+    mappingLength = exchange(other.mappingLength, 0);
+    keys = exchange(other.keys, nullptr);
+    rowIds = exchange(other.rowIds, nullptr);
+    return *this;
+}
+//---------------------------------------------------------------------------
+SortedIndex::~SortedIndex()
+// Destructor
+{
+    if (mapping)
+        munmap(mapping, mappingLength);
+}
+//---------------------------------------------------------------------------
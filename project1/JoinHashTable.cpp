@@ -0,0 +1,344 @@
+#include "JoinHashTable.hpp"
+#include <algorithm>
+#include <thread>
+#include "Operators.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// The number of keys that are gathered at once
+static constexpr unsigned keyChunkSize = 256;
+//---------------------------------------------------------------------------
+template <typename Consume>
+static void forEachKey(const ColumnView& keys, uint64_t begin, uint64_t end,
+                       Consume&& consume)
+// Call consume(i, key) for the keys [begin, end), they are gathered (and
+// decoded) in chunks
+{
+    uint64_t chunk[keyChunkSize];
+    for (uint64_t i = begin; i < end; i += keyChunkSize)
+    {
+        const unsigned n = min<uint64_t>(keyChunkSize, end - i);
+        keys.gather(i, n, chunk);
+        for (unsigned j = 0; j < n; ++j)
+            consume(i + j, chunk[j]);
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void JoinHashTable<RowId>::build(const ColumnView& keys, uint64_t size,
+                                 RowIds rowIds, const KeyDomain* domain)
+// Build the table on the first size keys of a column
+{
+    // About one entry per bucket, at least two buckets
+    unsigned bucketBits = 1;
+    while ((1ull << bucketBits) < size)
+        ++bucketBits;
+    shift = 64 - bucketBits;
+    uint64_t numBuckets = 1ull << bucketBits;
+
+    // The domain of the keys: a known domain that is dense is used right
+    // away, otherwise the keys might still be dense and are scanned
+    BlockInfo bi(0, size);
+    uint64_t maxKey;
+    if (domain && size != 0 && domain->max - domain->min < numBuckets)
+    {
+        minKey = domain->min;
+        maxKey = domain->max;
+    }
+    else
+    {
+        vector<uint64_t> mins(bi.blockCount, ~0ull), maxs(bi.blockCount, 0);
+        parallel_for(bi, [keys, &mins, &maxs](unsigned rank, uint64_t begin,
+                                              uint64_t end) {
+            uint64_t localMin = ~0ull, localMax = 0;
+            forEachKey(keys, begin, end, [&](uint64_t, uint64_t key) {
+                localMin = std::min(localMin, key);
+                localMax = std::max(localMax, key);
+            });
+            mins[rank] = localMin;
+            maxs[rank] = localMax;
+        });
+        minKey = *min_element(mins.begin(), mins.end());
+        maxKey = *max_element(maxs.begin(), maxs.end());
+    }
+    // Dense keys are direct-addressed if their directory is not larger
+    dense = size != 0 && maxKey - minKey < numBuckets;
+    if (dense)
+        numBuckets = maxKey - minKey + 1;
+
+    directory.assign(numBuckets + 1, 0);
+    entries.resize(size);
+    auto tuple = [keys, rowIds](uint64_t i) {
+        return Entry{ keys[i], RowId(rowIds[i]) };
+    };
+
+    // The buckets are split into ranges by their high bits. The tuples are
+    // partitioned by these ranges first, then every range fills its buckets
+    // independently, so no bucket is written concurrently.
+    unsigned domainBits = 0;
+    while ((1ull << domainBits) < numBuckets)
+        ++domainBits;
+    const unsigned partitionBits = choosePartitionBits(size, domainBits);
+    const unsigned partitionShift = domainBits - partitionBits;
+    if (partitionBits == 0)
+    {
+        fillBuckets(tuple, size, 0, numBuckets, 0);
+        directory[numBuckets] = size;
+        return;
+    }
+
+    // Histogram phase: every block counts its tuples of each range
+    const unsigned fanOut = 1u << partitionBits;
+    auto partitionOf = [this, partitionShift](uint64_t key) {
+        return bucketOf(key, dense ? 0 : hash(key)) >> partitionShift;
+    };
+    vector<vector<uint64_t>> histograms(bi.blockCount,
+                                        vector<uint64_t>(fanOut));
+    parallel_for(bi, [keys, &histograms, &partitionOf](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        auto& histogram = histograms[rank];
+        forEachKey(keys, begin, end, [&](uint64_t, uint64_t key) {
+            ++histogram[partitionOf(key)];
+        });
+    });
+
+    // Every block writes its part of a range in rank order, so the scatter
+    // is stable. A range starts where its buckets start in the entries.
+    vector<uint64_t> partitionOffsets(fanOut + 1);
+    uint64_t offset = 0;
+    for (unsigned p = 0; p < fanOut; ++p)
+    {
+        partitionOffsets[p] = offset;
+        for (auto& histogram : histograms)
+        {
+            const uint64_t count = histogram[p];
+            histogram[p] = offset;
+            offset += count;
+        }
+    }
+    partitionOffsets[fanOut] = offset;
+
+    // Scatter phase
+    vector<Entry> partitioned(size);
+    parallel_for(bi, [keys, rowIds, &histograms, &partitioned, &partitionOf](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        auto& cursors = histograms[rank];
+        forEachKey(keys, begin, end, [&](uint64_t i, uint64_t key) {
+            partitioned[cursors[partitionOf(key)]++] =
+                Entry{ key, RowId(rowIds[i]) };
+        });
+    });
+
+    // Bucket phase: every range counts, places and groups its tuples
+    parallel_for(BlockInfo(0, fanOut, 1), [&](unsigned, uint64_t begin,
+                                              uint64_t end) {
+        for (uint64_t p = begin; p < end; ++p)
+        {
+            const uint64_t first = partitionOffsets[p];
+            const uint64_t firstBucket = p << partitionShift;
+            if (firstBucket >= numBuckets)
+                continue;
+            fillBuckets(
+                [&partitioned, first](uint64_t i) {
+                    return partitioned[first + i];
+                },
+                partitionOffsets[p + 1] - first, firstBucket,
+                min(numBuckets, (p + 1) << partitionShift), first);
+        }
+    });
+    directory[numBuckets] = size;
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+unsigned JoinHashTable<RowId>::choosePartitionBits(uint64_t size,
+                                                   unsigned domainBits)
+// Choose the number of bits of the bucket ranges of a build
+{
+    // Small builds fill their buckets directly, larger ones have a few ranges
+    // per worker, each of which fits into the cache
+    unsigned bits = 0;
+    if (size <= partitionSize)
+        return bits;
+    const unsigned maxBits = min(maxPartitionBits, domainBits);
+    while (bits < maxBits && (size >> bits) > partitionSize)
+        ++bits;
+    const unsigned minPartitions = 4 * thread::hardware_concurrency();
+    while (bits < maxBits && (1u << bits) < minPartitions)
+        ++bits;
+    return bits;
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+template <typename Tuples>
+void JoinHashTable<RowId>::fillBuckets(const Tuples& tuples, uint64_t count,
+                                       uint64_t firstBucket,
+                                       uint64_t endBucket, uint64_t offset)
+// Place the tuples of the buckets [firstBucket, endBucket) at offset
+{
+    // Count the entries and collect the tags of each bucket
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const uint64_t key = tuples(i).key;
+        const uint64_t h = dense ? 0 : hash(key);
+        auto& slot = directory[bucketOf(key, h)];
+        ++slot;
+        if (!dense)
+            slot |= tag(h);
+    }
+
+    // Turn the counts into offsets, the tags stay in the high bits
+    vector<uint64_t> cursors(endBucket - firstBucket);
+    for (uint64_t b = firstBucket; b < endBucket; ++b)
+    {
+        const uint64_t bucketCount = directory[b] & offsetMask;
+        directory[b] = (directory[b] & ~offsetMask) | offset;
+        cursors[b - firstBucket] = offset;
+        offset += bucketCount;
+    }
+
+    // Place the entries in their order, so the row ids of a key stay sorted
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const Entry entry = tuples(i);
+        entries[cursors[bucketOf(entry.key, dense ? 0 : hash(entry.key)) -
+                        firstBucket]++] = entry;
+    }
+    if (dense)
+        return;
+
+    // Make the duplicates of each key adjacent. Most buckets hold a single
+    // key. In a small bucket with colliding keys, every entry is moved
+    // behind the earlier entries of its key. A large one is partitioned once
+    // per key, which is linear for a heavy hitter. Both keep the order of
+    // the row ids.
+    for (uint64_t b = firstBucket; b < endBucket; ++b)
+    {
+        auto first = entries.begin() + (directory[b] & offsetMask);
+        auto last = entries.begin() + cursors[b - firstBucket];
+        if (last - first <= smallBucketSize)
+        {
+            for (auto e = first + 1; e < last; ++e)
+            {
+                if (e->key == (e - 1)->key)
+                    continue;
+                auto previous = e - 1;
+                while (previous != first && previous->key != e->key)
+                    --previous;
+                if (previous->key == e->key)
+                    rotate(previous + 1, e, e + 1);
+            }
+            continue;
+        }
+        while (last - first > 1)
+        {
+            const uint64_t key = first->key;
+            first = stable_partition(first, last, [key](const Entry& e) {
+                return e.key == key;
+            });
+        }
+    }
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void JoinHashTable<RowId>::removeDuplicates()
+// Keep the first entry of each key
+{
+    // The duplicates of a key are adjacent, every block counts the keys that
+    // start in it
+    const uint64_t size = entries.size();
+    BlockInfo bi(0, size);
+    vector<uint64_t> firstKept(bi.blockCount + 1);
+    parallel_for(bi, [this, &firstKept](unsigned rank, uint64_t begin,
+                                        uint64_t end) {
+        uint64_t starts = 0;
+        for (uint64_t e = begin; e < end; ++e)
+            starts += e == 0 || entries[e - 1].key != entries[e].key;
+        firstKept[rank + 1] = starts;
+    });
+    for (unsigned b = 0; b < bi.blockCount; ++b)
+        firstKept[b + 1] += firstKept[b];
+    const uint64_t numKept = firstKept[bi.blockCount];
+
+    // Move the first entries to their new positions and note the new
+    // position of every old one
+    vector<Entry> kept(numKept);
+    vector<RowId> positions(size + 1);
+    positions[size] = numKept;
+    parallel_for(bi, [this, &firstKept, &kept, &positions](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        uint64_t position = firstKept[rank];
+        for (uint64_t e = begin; e < end; ++e)
+        {
+            positions[e] = position;
+            if (e == 0 || entries[e - 1].key != entries[e].key)
+            {
+                kept[position] = Entry{ entries[e].key, RowId(position) };
+                ++position;
+            }
+        }
+    });
+
+    // Every bucket starts with a new key (or is empty), so its offset is
+    // the position of its first entry
+    parallel_for(BlockInfo(0, directory.size()), [this, &positions](
+                                                     unsigned, uint64_t begin,
+                                                     uint64_t end) {
+        for (uint64_t b = begin; b < end; ++b)
+            directory[b] = (directory[b] & ~offsetMask) |
+                           positions[directory[b] & offsetMask];
+    });
+    entries = move(kept);
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void JoinHashTable<RowId>::probe(const ColumnView& keys, uint64_t begin,
+                                 uint64_t end, Range* ranges) const
+// Find the entries of the keys [begin, end) of a column, group-prefetched
+{
+    // A table that fits into the cache is probed directly, prefetching would
+    // only cost instructions
+    const uint64_t numBuckets = this->numBuckets();
+    if ((numBuckets + 1) * sizeof(uint64_t) + entries.size() * sizeof(Entry) <=
+        cacheResidentSize)
+    {
+        forEachKey(keys, begin, end, [this, ranges](uint64_t i, uint64_t key) {
+            ranges[i] = probe(key);
+        });
+        return;
+    }
+
+    uint64_t groupKeys[probeGroupSize];
+    uint64_t hashes[probeGroupSize];
+    for (uint64_t g = begin; g < end; g += probeGroupSize)
+    {
+        const unsigned n = min<uint64_t>(probeGroupSize, end - g);
+        // Stage 1: hash the keys and prefetch their directory slots
+        keys.gather(g, n, groupKeys);
+        for (unsigned j = 0; j < n; ++j)
+        {
+            hashes[j] = dense ? 0 : hash(groupKeys[j]);
+            const uint64_t bucket = bucketOf(groupKeys[j], hashes[j]);
+            if (bucket < numBuckets)
+                __builtin_prefetch(&directory[bucket]);
+        }
+        // Stage 2: prefetch the first entry of the buckets that might
+        // contain the key
+        for (unsigned j = 0; j < n; ++j)
+        {
+            const uint64_t bucket = bucketOf(groupKeys[j], hashes[j]);
+            if (bucket >= numBuckets)
+                continue;
+            const uint64_t slot = directory[bucket];
+            if (dense || (slot & tag(hashes[j])))
+                __builtin_prefetch(&entries[slot & offsetMask]);
+        }
+        // Stage 3: probe, the accessed lines are in the cache by now
+        for (unsigned j = 0; j < n; ++j)
+            ranges[g + j] = probe(groupKeys[j], hashes[j]);
+    }
+}
+//---------------------------------------------------------------------------
+template class JoinHashTable<uint32_t>;
+template class JoinHashTable<uint64_t>;
+//---------------------------------------------------------------------------
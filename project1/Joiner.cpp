@@ -1,6 +1,8 @@
 #include "Joiner.hpp"
 #include <cassert>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
@@ -8,6 +10,11 @@
 #include <utility>
 #include <vector>
 #include "Parser.hpp"
+#include "Pipeline.hpp"
+#include "Planner.hpp"
+#include "SemiJoinReducer.hpp"
+#include "SharedScan.hpp"
+#include "ThreadPool.hpp"
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
@@ -17,6 +24,53 @@ void Joiner::addRelation(const char* fileName)
     relations.emplace_back(fileName);
 }
 //---------------------------------------------------------------------------
+uint64_t Joiner::addRelations(const vector<string>& fileNames)
+// Loads relations from disk concurrently
+{
+    // Every relation prefaults its own pages in parallel as well
+    vector<unique_ptr<Relation>> loaded(fileNames.size());
+    BlockInfo bi(0, fileNames.size(), 1);
+    parallel_for(bi, [&](unsigned, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+            loaded[i] = make_unique<Relation>(fileNames[i].c_str());
+    });
+
+    uint64_t bytes = 0;
+    for (auto& relation : loaded)
+    {
+        bytes += relation->getFileLength();
+        relations.push_back(move(*relation));
+    }
+    return bytes;
+}
+//---------------------------------------------------------------------------
+uint64_t Joiner::prepare()
+// Collect the statistics, build the indexes and compress the columns (if
+// enabled) of all relations (preparation phase)
+{
+    // The relations are prepared concurrently, so small relations do not
+    // leave the pool idle, and the kernels of each relation run in parallel
+    BlockInfo bi(0, relations.size(), 1);
+    parallel_for(bi, [this](unsigned, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            auto& r = relations[i];
+            // Relation files in format version 2 contain the statistics
+            if (r.statistics.size() != r.columns.size())
+                r.collectStatistics();
+            // The indexes are built from the uncompressed values
+            r.buildIndexes();
+            if (compression)
+                r.compressColumns();
+        }
+    });
+
+    uint64_t bytes = 0;
+    for (auto& r : relations)
+        bytes += r.memoryUsage();
+    return bytes;
+}
+//---------------------------------------------------------------------------
 Relation& Joiner::getRelation(unsigned relationId)
 // Loads a relation from disk
 {
@@ -29,10 +83,19 @@ Relation& Joiner::getRelation(unsigned relationId)
 }
 //---------------------------------------------------------------------------
 unique_ptr<Operator> Joiner::addScan(set<unsigned>& usedRelations,
-                                     SelectInfo& info, QueryInfo& query)
+                                     SelectInfo& info, QueryInfo& query,
+                                     const ReducedRowIds& reduced)
 // Add scan to query
 {
     usedRelations.emplace(info.binding);
+    // The semi-joins have applied the filters already
+    if (!reduced.empty())
+    {
+        auto scan = make_unique<Scan>(getRelation(info.relId), info.binding);
+        scan->setRowIds(reduced[info.binding]);
+        return scan;
+    }
+
     vector<FilterInfo> filters;
     for (auto& f : query.filters)
     {
@@ -41,9 +104,13 @@ unique_ptr<Operator> Joiner::addScan(set<unsigned>& usedRelations,
             filters.emplace_back(f);
         }
     }
-    return filters.size()
-               ? make_unique<FilterScan>(getRelation(info.relId), filters)
-               : make_unique<Scan>(getRelation(info.relId), info.binding);
+    if (filters.empty())
+        return make_unique<Scan>(getRelation(info.relId), info.binding);
+
+    auto scan = make_unique<FilterScan>(getRelation(info.relId), filters);
+    if (shareResults)
+        scan->setCache(&batchCache);
+    return scan;
 }
 //---------------------------------------------------------------------------
 enum QueryGraphProvides
@@ -69,20 +136,46 @@ static QueryGraphProvides analyzeInputOfJoin(set<unsigned>& usedRelations,
     return QueryGraphProvides::None;
 }
 //---------------------------------------------------------------------------
-string Joiner::join(QueryInfo& query)
-// Executes a join query
+void Joiner::runMaterialized(QueryInfo& query, vector<uint64_t>& checkSums,
+                             uint64_t& resultSize)
+// Execute a query with operators that materialize their results
 {
-    // cerr << query.dumpText() << endl;
     set<unsigned> usedRelations;
 
-    // We always start with the first join predicate and append the other joins
-    // to it (--> left-deep join trees) You might want to choose a smarter join
-    // ordering ...
+    // Acyclic queries are reduced to the tuples that take part in the result
+    // first, so there are no dangling intermediate results
+    ReducedRowIds reduced;
+    if (semiJoinReduction)
+    {
+        SemiJoinReducer reducer(relations, query,
+                                shareResults ? &batchCache : nullptr);
+        if (reducer.run())
+            reduced = move(reducer.rowIds);
+    }
+
+    // The planner orders the join predicates, we always start with the first
+    // join predicate and append the other joins to it (--> left-deep join
+    // trees). Repeated queries reuse the order.
+    if (cachePlans)
+    {
+        auto order = planCache.get<vector<PredicateInfo>>(
+            "joins " + query.dumpText(), [this, &query] {
+                Planner(relations).orderJoins(query);
+                return make_shared<const vector<PredicateInfo>>(
+                    query.predicates);
+            });
+        query.predicates = *order;
+    }
+    else
+    {
+        Planner(relations).orderJoins(query);
+    }
     auto& firstJoin = query.predicates[0];
-    auto left = addScan(usedRelations, firstJoin.left, query);
-    auto right = addScan(usedRelations, firstJoin.right, query);
+    auto left = addScan(usedRelations, firstJoin.left, query, reduced);
+    auto right = addScan(usedRelations, firstJoin.right, query, reduced);
     unique_ptr<Operator> root =
-        make_unique<Join>(move(left), move(right), firstJoin);
+        make_unique<Join>(move(left), move(right), firstJoin,
+                          joinAlgorithm);
 
     for (unsigned i = 1; i < query.predicates.size(); ++i)
     {
@@ -94,13 +187,15 @@ string Joiner::join(QueryInfo& query)
         {
             case QueryGraphProvides::Left:
                 left = move(root);
-                right = addScan(usedRelations, rightInfo, query);
-                root = make_unique<Join>(move(left), move(right), pInfo);
+                right = addScan(usedRelations, rightInfo, query, reduced);
+                root = make_unique<Join>(move(left), move(right), pInfo,
+                                         joinAlgorithm);
                 break;
             case QueryGraphProvides::Right:
-                left = addScan(usedRelations, leftInfo, query);
+                left = addScan(usedRelations, leftInfo, query, reduced);
                 right = move(root);
-                root = make_unique<Join>(move(left), move(right), pInfo);
+                root = make_unique<Join>(move(left), move(right), pInfo,
+                                         joinAlgorithm);
                 break;
             case QueryGraphProvides::Both:
                 // All relations of this join are already used somewhere else in
@@ -118,12 +213,36 @@ string Joiner::join(QueryInfo& query)
 
     Checksum checkSum(move(root), query.selections);
     checkSum.run();
+    checkSums = move(checkSum.checkSums);
+    resultSize = checkSum.resultSize;
+}
+//---------------------------------------------------------------------------
+string Joiner::join(QueryInfo& query)
+// Executes a join query
+{
+    // cerr << query.dumpText() << endl;
+    vector<uint64_t> results;
+    uint64_t resultSize = 0;
+    if (execution != Execution::Materialized &&
+        Pipeline::supports(relations, query))
+    {
+        Pipeline pipeline(relations, query,
+                          execution == Execution::Factorized,
+                          shareResults ? &batchCache : nullptr,
+                          cachePlans ? &planCache : nullptr);
+        pipeline.run();
+        results = move(pipeline.checkSums);
+        resultSize = pipeline.resultSize;
+    }
+    else
+    {
+        runMaterialized(query, results, resultSize);
+    }
 
     stringstream out;
-    auto& results = checkSum.checkSums;
     for (unsigned i = 0; i < results.size(); ++i)
     {
-        out << (checkSum.resultSize == 0 ? "NULL" : to_string(results[i]));
+        out << (resultSize == 0 ? "NULL" : to_string(results[i]));
         if (i < results.size() - 1)
             out << " ";
     }
@@ -131,3 +250,55 @@ string Joiner::join(QueryInfo& query)
     return out.str();
 }
 //---------------------------------------------------------------------------
+void Joiner::prepareBatch(vector<QueryInfo>& queries)
+// Plan a batch before its queries run
+{
+    if (!shareResults)
+        return;
+
+    // The distinct filter sets on each relation and how often they are used
+    map<RelationId, map<string, vector<FilterInfo>>> filterSets;
+    map<RelationId, unsigned> uses;
+    for (auto& query : queries)
+    {
+        for (unsigned b = 0; b < query.relationIds.size(); ++b)
+        {
+            vector<FilterInfo> filters;
+            for (auto& f : query.filters)
+                if (f.filterColumn.binding == b)
+                    filters.push_back(f);
+            if (filters.empty())
+                continue;
+            auto relId = query.relationIds[b];
+            filterSets[relId].emplace(
+                BatchCache::scanKey(relId, b, filters), move(filters));
+            ++uses[relId];
+        }
+    }
+
+    // Relations that are filtered once are scanned by their query
+    for (auto& [relId, sets] : filterSets)
+    {
+        if (uses[relId] < 2)
+            continue;
+        vector<string> keys;
+        vector<vector<FilterInfo>> filters;
+        for (auto& [key, set] : sets)
+        {
+            keys.push_back(key);
+            filters.push_back(set);
+        }
+        SharedScan scan(getRelation(relId), move(filters));
+        scan.run();
+        for (unsigned s = 0; s < keys.size(); ++s)
+            batchCache.put(keys[s], make_shared<const RowIdColumn>(
+                                        move(scan.results[s])));
+    }
+}
+//---------------------------------------------------------------------------
+void Joiner::endBatch()
+// Drop the shared results of a batch
+{
+    batchCache.clear();
+}
+//---------------------------------------------------------------------------
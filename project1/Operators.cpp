@@ -1,13 +1,98 @@
 #include <Operators.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <iostream>
 
+#include <BatchCache.hpp>
+#include <FilterKernels.hpp>
+#include <Materialize.hpp>
 #include <ThreadPool.hpp>
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
+void Operator::addRequiredColumn(SelectInfo info)
+// Add a column to the results, its binding gets a row id column
+{
+    select2ResultColId[info] = requiredColumns.size();
+    requiredColumns.push_back(info);
+    if (binding2RowIdColId.find(info.binding) == binding2RowIdColId.end())
+    {
+        binding2RowIdColId[info.binding] = tmpResults.size();
+        tmpResults.emplace_back();
+    }
+}
+//---------------------------------------------------------------------------
+bool Operator::narrowRowIds()
+// Can the row ids of all bindings be stored in 32 bits?
+{
+    for (auto& [binding, relation] : binding2Relation)
+        if (!RowIdColumn::fits(relation->size))
+            return false;
+    return true;
+}
+//---------------------------------------------------------------------------
+RowIds Operator::getRowIds(unsigned binding)
+// Get the row ids of a binding
+{
+    assert(binding2RowIdColId.find(binding) != binding2RowIdColId.end());
+    return tmpResults[binding2RowIdColId[binding]].view();
+}
+//---------------------------------------------------------------------------
+vector<uint64_t*> Operator::getResults()
+// Get materialized results
+{
+    materializedResults.resize(requiredColumns.size());
+    vector<uint64_t*> resultVector;
+    for (unsigned cId = 0; cId < requiredColumns.size(); ++cId)
+    {
+        auto column = getColumn(requiredColumns[cId]);
+        auto& values = materializedResults[cId];
+        values.resize(resultSize);
+        for (uint64_t i = 0; i < resultSize; ++i)
+            values[i] = column[i];
+        resultVector.push_back(values.data());
+    }
+    return resultVector;
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+static vector<RowId*> resizeRowIds(vector<RowIdColumn>& columns,
+                                   uint64_t size)
+// Replace the row id columns by columns of size row ids of type RowId
+{
+    vector<RowId*> rowIds;
+    for (auto& column : columns)
+    {
+        column = RowIdColumn(sizeof(RowId) == sizeof(uint32_t));
+        column.resize(size);
+        rowIds.push_back(column.data<RowId>());
+    }
+    return rowIds;
+}
+//---------------------------------------------------------------------------
+template <typename Write>
+static void writeRowIds(vector<RowIdColumn>& columns, bool narrow,
+                        uint64_t size, Write&& write)
+// Resize the row id columns (to 32 bit row ids if narrow) and call
+// write(rowIds) with the row ids of each column
+{
+    if (narrow)
+        write(resizeRowIds<uint32_t>(columns, size));
+    else
+        write(resizeRowIds<uint64_t>(columns, size));
+}
+//---------------------------------------------------------------------------
+/// The index nested loop join is chosen if the indexed right input is
+/// larger than the left input by this factor
+static constexpr uint64_t indexJoinFactor = 32;
+/// The number of build tuples from which the radix join is chosen
+static constexpr uint64_t radixJoinThreshold = 1u << 16;
+/// A filter is evaluated through the index of its column if at most this
+/// fraction of the relation qualifies
+static constexpr uint64_t indexScanFactor = 64;
+//---------------------------------------------------------------------------
 bool Scan::require(SelectInfo info)
 // Require a column and add it to results
 {
@@ -15,6 +100,7 @@ bool Scan::require(SelectInfo info)
         return false;
     assert(info.colId < relation.columns.size());
     resultColumns.push_back(relation.columns[info.colId]);
+    requiredColumns.push_back(info);
     select2ResultColId[info] = resultColumns.size() - 1;
     return true;
 }
@@ -22,106 +108,212 @@ bool Scan::require(SelectInfo info)
 void Scan::run()
 // Run
 {
-    // Nothing to do
-    resultSize = relation.size;
+    if (sharedRowIds)
+        resultSize = sharedRowIds->size();
+    else if (bloomFilter)
+        selectRows({});
+    else
+        resultSize = relation.size;
 }
 //---------------------------------------------------------------------------
 vector<uint64_t*> Scan::getResults()
 // Get materialized results
 {
-    return resultColumns;
+    // The uncompressed columns of all rows are returned as they are,
+    // otherwise the values of the selected rows are gathered (and decoded)
+    if (!getRowIds(relationBinding) &&
+        find(resultColumns.begin(), resultColumns.end(), nullptr) ==
+            resultColumns.end())
+        return resultColumns;
+    return Operator::getResults();
 }
 //---------------------------------------------------------------------------
-bool FilterScan::require(SelectInfo info)
-// Require a column and add it to results
+bool Scan::wantsBloomFilter(SelectInfo column, uint64_t numKeys)
+// Would a Bloom filter drop enough tuples?
 {
-    if (info.binding != relationBinding)
+    if (column.binding != relationBinding || relation.statistics.empty() ||
+        sharedRowIds)
         return false;
-    assert(info.colId < relation.columns.size());
-    if (select2ResultColId.find(info) == select2ResultColId.end())
+    // At least half of the distinct keys of the scan cannot find a partner
+    return numKeys * 2 < relation.statistics[column.colId].distinct;
+}
+//---------------------------------------------------------------------------
+const SortedIndex* Scan::getIndex(SelectInfo column)
+// Get the sorted index of a column
+{
+    if (column.binding != relationBinding || bloomFilter || sharedRowIds ||
+        relation.indexes.empty())
+        return nullptr;
+    return &relation.indexes[column.colId];
+}
+//---------------------------------------------------------------------------
+void Scan::pushBloomFilter(SelectInfo column, const BloomFilter* bloomFilter)
+// Push a Bloom filter on a column into the operator
+{
+    assert(column.binding == relationBinding);
+    this->bloomFilter = bloomFilter;
+    bloomColumn = column.colId;
+    // The qualifying row ids are materialized now
+    if (binding2RowIdColId.find(relationBinding) == binding2RowIdColId.end())
     {
-        // Add to results
-        inputData.push_back(relation.columns[info.colId]);
+        binding2RowIdColId[relationBinding] = tmpResults.size();
         tmpResults.emplace_back();
-        unsigned colId = tmpResults.size() - 1;
-        select2ResultColId[info] = colId;
     }
-    return true;
 }
 //---------------------------------------------------------------------------
-void FilterScan::copy2Result(uint64_t id)
-// Copy to result
+void Scan::selectRows(const vector<FilterInfo>& filters)
+// Select the rows that pass the filters and the Bloom filter
 {
-    for (unsigned cId = 0; cId < inputData.size(); ++cId)
-        tmpResults[cId].push_back(inputData[cId][id]);
-    ++resultSize;
+    if (selectRowsByIndex(filters))
+        return;
+    if (narrowRowIds())
+        selectBlocks<uint32_t>(filters);
+    else
+        selectBlocks<uint64_t>(filters);
 }
 //---------------------------------------------------------------------------
-bool FilterScan::applyFilter(uint64_t i, FilterInfo& f)
-// Apply filter
+template <typename RowId>
+void Scan::selectBlocks(const vector<FilterInfo>& filters)
+// Select the rows block by block with the filter kernels
 {
-    auto compareCol = relation.columns[f.filterColumn.colId];
-    auto constant = f.constant;
-    switch (f.comparison)
-    {
-        case FilterInfo::Comparison::Equal:
-            return compareCol[i] == constant;
-        case FilterInfo::Comparison::Greater:
-            return compareCol[i] > constant;
-        case FilterInfo::Comparison::Less:
-            return compareCol[i] < constant;
+    // Calls consume(selection, count) for each kernel block of [begin, end),
+    // the blocks are aligned to the zones of the zone maps
+    auto forEachBlock = [this, &filters](uint64_t begin, uint64_t end,
+                                         auto&& consume) {
+        RowId selection[FilterKernels::selectionSize];
+        for (uint64_t i = begin, blockEnd; i < end; i = blockEnd)
+        {
+            blockEnd = std::min<uint64_t>(
+                end, (i / FilterKernels::blockSize + 1) *
+                         FilterKernels::blockSize);
+            unsigned count = FilterKernels::select(relation, filters, i,
+                                                   blockEnd, selection);
+            if (bloomFilter)
+                count = bloomFilter->filter(relation.column(bloomColumn),
+                                            selection, count);
+            consume(selection, count);
+        }
     };
-    return false;
+
+    // Count the qualifying rows of each block, then write them directly to
+    // their offsets
+    Materializer materializer(BlockInfo(0, relation.size));
+    materializer.count([&forEachBlock](uint64_t begin, uint64_t end,
+                                       uint64_t* counts) {
+        uint64_t localResultSize = 0;
+        forEachBlock(begin, end, [&](const RowId*, unsigned count) {
+            localResultSize += count;
+        });
+        counts[0] = localResultSize;
+    });
+
+    resultSize = materializer.size();
+    RowId* rowIds = resizeRowIds<RowId>(
+        tmpResults, resultSize)[binding2RowIdColId[relationBinding]];
+    materializer.scatter([&forEachBlock, rowIds](uint64_t begin, uint64_t end,
+                                                  const uint64_t* offsets) {
+        RowId* out = rowIds + offsets[0];
+        forEachBlock(begin, end, [&](const RowId* selection, unsigned count) {
+            out = std::copy(selection, selection + count, out);
+        });
+    });
 }
 //---------------------------------------------------------------------------
-void FilterScan::run()
-// Run
+bool Scan::selectRowsByIndex(const vector<FilterInfo>& filters)
+// Select the rows through the index of the most selective filter
 {
-    BlockInfo bi(0, relation.size);
-
-    std::atomic<uint64_t> atmResultSize = 0;
-    std::vector<std::vector<std::vector<uint64_t>>> subResults(bi.blockCount, tmpResults);
+    if (relation.indexes.empty())
+        return false;
 
-    parallel_for(bi, [this, &atmResultSize, &subResults](
-                         unsigned rank, uint64_t begin, uint64_t end) {
-        uint64_t localResultSize = 0;
-        for (unsigned i = begin; i < end; ++i)
+    // The filter with the fewest qualifying index entries
+    const FilterInfo* indexFilter = nullptr;
+    pair<uint64_t, uint64_t> range;
+    for (auto& f : filters)
+    {
+        auto fRange = relation.indexes[f.filterColumn.colId].filterRange(f);
+        if (!indexFilter ||
+            fRange.second - fRange.first < range.second - range.first)
         {
-            bool pass = true;
-            for (auto& f : filters)
-            {
-                pass &= applyFilter(i, f);
-            }
-            if (pass)
-            {
-                for (unsigned cId = 0; cId < inputData.size(); ++cId)
-                    subResults[rank][cId].push_back(inputData[cId][i]);
-                ++localResultSize;
-            }
+            indexFilter = &f;
+            range = fRange;
         }
-        std::atomic_fetch_add(&atmResultSize, localResultSize);
+    }
+    if (!indexFilter ||
+        (range.second - range.first) * indexScanFactor > relation.size)
+        return false;
+
+    // The candidates in the order of the relation
+    auto& index = relation.indexes[indexFilter->filterColumn.colId];
+    vector<uint64_t> candidates(index.rowIds + range.first,
+                                index.rowIds + range.second);
+    sort(candidates.begin(), candidates.end());
+
+    // The candidates are checked against the other filters and the Bloom
+    // filter
+    auto passes = [this, &filters, indexFilter](uint64_t rowId) {
+        for (auto& f : filters)
+            if (&f != indexFilter &&
+                !FilterKernels::passes(
+                    f, relation.column(f.filterColumn.colId)[rowId]))
+                return false;
+        return !bloomFilter ||
+               bloomFilter->contains(relation.column(bloomColumn)[rowId]);
+    };
+    Materializer materializer(BlockInfo(0, candidates.size()));
+    materializer.count([&candidates, &passes](uint64_t begin, uint64_t end,
+                                              uint64_t* counts) {
+        uint64_t localResultSize = 0;
+        for (uint64_t i = begin; i < end; ++i)
+            localResultSize += passes(candidates[i]);
+        counts[0] = localResultSize;
     });
 
-    for (const auto& subResult : subResults)
+    resultSize = materializer.size();
+    const unsigned colId = binding2RowIdColId[relationBinding];
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        materializer.scatter([&candidates, &passes, out = rowIds[colId]](
+                                 uint64_t begin, uint64_t end,
+                                 const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
+            for (uint64_t i = begin; i < end; ++i)
+                if (passes(candidates[i]))
+                    out[offset++] = candidates[i];
+        });
+    });
+    return true;
+}
+//---------------------------------------------------------------------------
+bool FilterScan::require(SelectInfo info)
+// Require a column and add it to results
+{
+    if (info.binding != relationBinding)
+        return false;
+    assert(info.colId < relation.columns.size());
+    if (select2ResultColId.find(info) == select2ResultColId.end())
     {
-        const unsigned totalSize = tmpResults.size();
-        for (unsigned i = 0; i < totalSize; ++i)
-            tmpResults[i].insert(end(tmpResults[i]), begin(subResult[i]),
-                                 end(subResult[i]));
+        // Add to results
+        addRequiredColumn(info);
     }
-
-    resultSize = atmResultSize.load();
+    return true;
 }
 //---------------------------------------------------------------------------
-vector<uint64_t*> Operator::getResults()
-// Get materialized results
+void FilterScan::run()
+// Run
 {
-    vector<uint64_t*> resultVector;
-    for (auto& c : tmpResults)
+    // A Bloom filter makes the result specific to this query
+    if (!cache || bloomFilter)
     {
-        resultVector.push_back(c.data());
+        selectRows(filters);
+        return;
     }
-    return resultVector;
+
+    auto key = BatchCache::scanKey(filters[0].filterColumn.relId,
+                                   relationBinding, filters);
+    sharedRowIds = cache->get<RowIdColumn>(key, [this] {
+        selectRows(filters);
+        return make_shared<const RowIdColumn>(move(tmpResults[0]));
+    });
+    resultSize = sharedRowIds->size();
 }
 //---------------------------------------------------------------------------
 bool Join::require(SelectInfo info)
@@ -129,38 +321,31 @@ bool Join::require(SelectInfo info)
 {
     if (requestedColumns.count(info) == 0)
     {
-        bool success = false;
+        bool newBinding =
+            binding2RowIdColId.find(info.binding) == binding2RowIdColId.end();
         if (left->require(info))
         {
-            requestedColumnsLeft.emplace_back(info);
-            success = true;
+            if (newBinding)
+                requestedBindingsLeft.emplace_back(info.binding);
+            binding2Relation[info.binding] = left->getRelation(info.binding);
         }
         else if (right->require(info))
         {
-            success = true;
-            requestedColumnsRight.emplace_back(info);
+            if (newBinding)
+                requestedBindingsRight.emplace_back(info.binding);
+            binding2Relation[info.binding] = right->getRelation(info.binding);
         }
-        if (!success)
+        else
+        {
             return false;
+        }
 
-        tmpResults.emplace_back();
+        addRequiredColumn(info);
         requestedColumns.emplace(info);
     }
     return true;
 }
 //---------------------------------------------------------------------------
-void Join::copy2Result(uint64_t leftId, uint64_t rightId)
-// Copy to result
-{
-    unsigned relColId = 0;
-    for (unsigned cId = 0; cId < copyLeftData.size(); ++cId)
-        tmpResults[relColId++].push_back(copyLeftData[cId][leftId]);
-
-    for (unsigned cId = 0; cId < copyRightData.size(); ++cId)
-        tmpResults[relColId++].push_back(copyRightData[cId][rightId]);
-    ++resultSize;
-}
-//---------------------------------------------------------------------------
 void Join::run()
 // Run
 {
@@ -168,118 +353,533 @@ void Join::run()
     right->require(pInfo.right);
 
     left->run();
+    // A few left keys are looked up in the index of the right input, which
+    // is not scanned then
+    const SortedIndex* index = nullptr;
+    if (algorithm == Algorithm::IndexNestedLoop ||
+        algorithm == Algorithm::Adaptive)
+        index = right->getIndex(pInfo.right);
+    if (index && algorithm == Algorithm::Adaptive &&
+        left->resultSize * indexJoinFactor >= index->size())
+        index = nullptr;
+
+    // Sideways information passing: the right input drops the tuples whose
+    // key cannot find a partner on the left while it is scanned
+    if (!index && right->wantsBloomFilter(pInfo.right, left->resultSize))
+        pushBloomFilter();
     right->run();
 
     // Use smaller input for build
-    if (left->resultSize > right->resultSize)
+    if (!index && left->resultSize > right->resultSize)
     {
         swap(left, right);
         swap(pInfo.left, pInfo.right);
-        swap(requestedColumnsLeft, requestedColumnsRight);
+        swap(requestedBindingsLeft, requestedBindingsRight);
     }
 
-    auto leftInputData = left->getResults();
-    auto rightInputData = right->getResults();
-
-    // Resolve the input columns
+    // Resolve the input row ids, left bindings come first in the result
     unsigned resColId = 0;
-    for (auto& info : requestedColumnsLeft)
+    for (auto binding : requestedBindingsLeft)
     {
-        copyLeftData.push_back(leftInputData[left->resolve(info)]);
-        select2ResultColId[info] = resColId++;
+        copyLeftData.push_back(left->getRowIds(binding));
+        binding2RowIdColId[binding] = resColId++;
     }
-    for (auto& info : requestedColumnsRight)
+    for (auto binding : requestedBindingsRight)
     {
-        copyRightData.push_back(rightInputData[right->resolve(info)]);
-        select2ResultColId[info] = resColId++;
+        copyRightData.push_back(right->getRowIds(binding));
+        binding2RowIdColId[binding] = resColId++;
     }
 
-    auto leftColId = left->resolve(pInfo.left);
-    auto rightColId = right->resolve(pInfo.right);
-
-    // Build phase
-    auto leftKeyColumn = leftInputData[leftColId];
-    hashTable.reserve(left->resultSize * 2);
-    for (uint64_t i = 0, limit = i + left->resultSize; i != limit; ++i)
+    auto leftKeyColumn = left->getColumn(pInfo.left);
+    auto rightKeyColumn = right->getColumn(pInfo.right);
+    if (index)
     {
-        hashTable.emplace(leftKeyColumn[i], i);
+        runIndexNestedLoop(leftKeyColumn, *index);
+        return;
     }
+    switch (chooseAlgorithm(leftKeyColumn, rightKeyColumn))
+    {
+        case Algorithm::Radix:
+            if (narrowPositions())
+                runRadix<uint32_t>(leftKeyColumn, rightKeyColumn);
+            else
+                runRadix<uint64_t>(leftKeyColumn, rightKeyColumn);
+            break;
+        case Algorithm::SortMerge:
+            runSortMerge(leftKeyColumn, rightKeyColumn);
+            break;
+        default:
+            if (narrowPositions())
+                runHash<uint32_t>(leftKeyColumn, rightKeyColumn);
+            else
+                runHash<uint64_t>(leftKeyColumn, rightKeyColumn);
+            break;
+    }
+}
+//---------------------------------------------------------------------------
+static bool isSorted(ColumnView column, uint64_t size)
+// Are the values of a column in ascending order?
+{
+    atomic<bool> sorted = true;
+    parallel_for(BlockInfo(0, size), [column, size, &sorted](
+                                         unsigned, uint64_t begin,
+                                         uint64_t end) {
+        // Compare with the previous value (of the previous block too)
+        for (uint64_t i = max<uint64_t>(begin, 1);
+             i < end && sorted.load(memory_order_relaxed); ++i)
+            if (column[i - 1] > column[i])
+                sorted.store(false, memory_order_relaxed);
+    });
+    return sorted.load();
+}
+//---------------------------------------------------------------------------
+Join::Algorithm Join::chooseAlgorithm(ColumnView leftKeyColumn,
+                                      ColumnView rightKeyColumn)
+// Choose the algorithm for the inputs (after they are run)
+{
+    // The index nested loop join is chosen before the inputs run, and the
+    // merge needs sorted inputs, otherwise the keys are hashed
+    auto hashAlgorithm = [this] {
+        // Partitioning pays off when the hash table does not fit into the
+        // cache
+        return left->resultSize > radixJoinThreshold ? Algorithm::Radix
+                                                     : Algorithm::Hash;
+    };
+    if (algorithm == Algorithm::IndexNestedLoop)
+        return Algorithm::Hash;
+    if (algorithm == Algorithm::SortMerge)
+        return isSorted(leftKeyColumn, left->resultSize) &&
+                       isSorted(rightKeyColumn, right->resultSize)
+                   ? Algorithm::SortMerge
+                   : hashAlgorithm();
+    if (algorithm != Algorithm::Adaptive)
+        return algorithm;
+
+    // Inputs on sorted base columns are often still sorted, they are merged
+    auto baseSorted = [this](SelectInfo info) {
+        auto relation = (info.binding == pInfo.left.binding ? left : right)
+                            ->getRelation(info.binding);
+        return !relation->statistics.empty() &&
+               relation->statistics[info.colId].sorted;
+    };
+    if (baseSorted(pInfo.left) && baseSorted(pInfo.right) &&
+        isSorted(leftKeyColumn, left->resultSize) &&
+        isSorted(rightKeyColumn, right->resultSize))
+        return Algorithm::SortMerge;
+    return hashAlgorithm();
+}
+//---------------------------------------------------------------------------
+void Join::pushBloomFilter()
+// Build a Bloom filter on the left keys and push it into the right input
+{
+    bloomFilter = make_unique<BloomFilter>(left->resultSize);
+    auto keys = left->getColumn(pInfo.left);
+    BlockInfo bi(0, left->resultSize);
+    parallel_for(bi, [this, keys](unsigned, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+            bloomFilter->insertConcurrent(keys[i]);
+    });
+    right->pushBloomFilter(pInfo.right, bloomFilter.get());
+}
+//---------------------------------------------------------------------------
+bool Join::narrowPositions() const
+// Can the positions of the input tuples be stored in 32 bits?
+{
+    return max(left->resultSize, right->resultSize) <= UINT32_MAX;
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void Join::runHash(ColumnView leftKeyColumn, ColumnView rightKeyColumn)
+// Build a single hash table on the left input and probe it
+{
+    // Build phase
+    JoinHashTable<RowId> hashTable;
+    hashTable.build(leftKeyColumn, left->resultSize);
+
+    // Probe phase: count the matches of each block, then write them directly
+    // to their offsets. The matches of a key are adjacent in the hash table.
+    vector<typename JoinHashTable<RowId>::Range> matches(right->resultSize);
+    Materializer materializer(BlockInfo(0, right->resultSize));
+    materializer.count([&hashTable, rightKeyColumn, &matches](
+                           uint64_t begin, uint64_t end, uint64_t* counts) {
+        hashTable.probe(rightKeyColumn, begin, end, matches.data());
+        uint64_t localResultSize = 0;
+        for (uint64_t i = begin; i < end; ++i)
+            localResultSize += matches[i].count;
+        counts[0] = localResultSize;
+    });
 
-    // Probe phase
-    BlockInfo bi(0, right->resultSize);
-
-    std::atomic<uint64_t> atmResultSize = 0;
-    std::vector<std::pair<HT::iterator, HT::iterator>> matches(
-        right->resultSize);
-    std::vector<uint64_t> matchCounts(right->resultSize);
+    resultSize = materializer.size();
+    if (resultSize == 0)
+        return;
 
-    auto rightKeyColumn = rightInputData[rightColId];
-    const uint64_t rightResultSize = right->resultSize;
-    parallel_for(
-        bi, [this, rightKeyColumn, &matches, &atmResultSize, &matchCounts, rightResultSize](
-                unsigned rank, uint64_t begin, uint64_t end) {
-            uint64_t localResultSize = 0;
+    const unsigned copyLeftSize = copyLeftData.size();
+    const unsigned copyRightSize = copyRightData.size();
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        materializer.scatter([this, &hashTable, &matches, &rowIds,
+                              copyLeftSize, copyRightSize](
+                                 uint64_t begin, uint64_t end,
+                                 const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
             for (uint64_t i = begin; i < end; ++i)
             {
-                auto rightKey = rightKeyColumn[i];
-                matches[i] = hashTable.equal_range(rightKey);
-
-                const uint64_t matchCount =
-                    std::distance(matches[i].first, matches[i].second);
-                localResultSize += matchCount;
+                const auto range = matches[i];
+                for (uint64_t e = range.offset, limit = e + range.count;
+                     e != limit; ++e, ++offset)
+                {
+                    const uint64_t leftId = hashTable[e].rowId;
+                    unsigned relColId = 0;
+                    for (unsigned cId = 0; cId < copyLeftSize; ++cId)
+                        rowIds[relColId++][offset] = copyLeftData[cId][leftId];
 
-                if (i < rightResultSize - 1)
-                    matchCounts[i + 1] = matchCount;
+                    for (unsigned cId = 0; cId < copyRightSize; ++cId)
+                        rowIds[relColId++][offset] = copyRightData[cId][i];
+                }
             }
-            std::atomic_fetch_add(&atmResultSize, localResultSize);
         });
+    });
+}
+//---------------------------------------------------------------------------
+/// A join key and the row it belongs to (packed like the entries of the
+/// join hash table)
+#pragma pack(push, 4)
+template <typename RowId>
+struct PartitionTuple
+{
+    uint64_t key;
+    RowId rowId;
+};
+#pragma pack(pop)
+//---------------------------------------------------------------------------
+/// The number of build tuples a partition should have to stay cache resident
+static constexpr uint64_t radixPartitionSize = 1u << 13;
+/// The maximum number of radix bits (fan-out of the partitioning pass)
+static constexpr unsigned maxRadixBits = 12;
+//---------------------------------------------------------------------------
+static inline uint64_t hashKey(uint64_t key)
+// Multiplicative hashing, the high bits are used for partitioning
+{
+    return key * 0x9E3779B97F4A7C15ull;
+}
+//---------------------------------------------------------------------------
+static unsigned chooseRadixBits(uint64_t buildSize, uint64_t probeSize)
+// Choose the number of radix bits for the given input sizes
+{
+    unsigned bits = 0;
+    while (bits < maxRadixBits && (buildSize >> bits) > radixPartitionSize)
+        ++bits;
+
+    // Have a few partitions per worker unless the inputs are tiny
+    if (buildSize + probeSize > radixPartitionSize)
+    {
+        const unsigned minPartitions = 4 * std::thread::hardware_concurrency();
+        while (bits < maxRadixBits && (1u << bits) < minPartitions)
+            ++bits;
+    }
+    return bits;
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+static void radixPartition(ColumnView keys, uint64_t size, unsigned bits,
+                           vector<PartitionTuple<RowId>>& tuples,
+                           vector<uint64_t>& partitionOffsets)
+// Scatter keys and row ids into 2^bits partitions
+{
+    const unsigned fanOut = 1u << bits;
+    const unsigned shift = 64 - bits;
+    auto partitionOf = [bits, shift](uint64_t key) -> unsigned {
+        return bits ? hashKey(key) >> shift : 0;
+    };
+
+    // Histogram phase
+    BlockInfo bi(0, size);
+    vector<vector<uint64_t>> histograms(bi.blockCount,
+                                        vector<uint64_t>(fanOut));
+    parallel_for(bi, [keys, &histograms, &partitionOf](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        auto& histogram = histograms[rank];
+        for (uint64_t i = begin; i < end; ++i)
+            ++histogram[partitionOf(keys[i])];
+    });
+
+    // Turn the histograms into write cursors. Each partition is contiguous
+    // and every block writes its part of a partition in rank order.
+    partitionOffsets.resize(fanOut + 1);
+    uint64_t offset = 0;
+    for (unsigned p = 0; p < fanOut; ++p)
+    {
+        partitionOffsets[p] = offset;
+        for (auto& histogram : histograms)
+        {
+            const uint64_t count = histogram[p];
+            histogram[p] = offset;
+            offset += count;
+        }
+    }
+    partitionOffsets[fanOut] = offset;
+
+    // Scatter phase
+    tuples.resize(size);
+    parallel_for(bi, [keys, &histograms, &tuples, &partitionOf](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        auto& cursors = histograms[rank];
+        for (uint64_t i = begin; i < end; ++i)
+            tuples[cursors[partitionOf(keys[i])]++] = { keys[i], RowId(i) };
+    });
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void Join::runRadix(ColumnView leftKeyColumn, ColumnView rightKeyColumn)
+// Partition both inputs and join the partitions independently
+{
+    const unsigned bits = chooseRadixBits(left->resultSize, right->resultSize);
+    const unsigned fanOut = 1u << bits;
+
+    // Partition phase
+    vector<PartitionTuple<RowId>> buildTuples, probeTuples;
+    vector<uint64_t> buildOffsets, probeOffsets;
+    radixPartition(leftKeyColumn, left->resultSize, bits, buildTuples,
+                   buildOffsets);
+    radixPartition(rightKeyColumn, right->resultSize, bits, probeTuples,
+                   probeOffsets);
+
+    // Build and probe phase: every partition gets its own small hash table,
+    // the bits below the radix bits select the bucket. A partition has at
+    // most as many tuples as its input, so its positions fit into a RowId.
+    constexpr RowId endOfChain = ~RowId(0);
+    vector<vector<pair<RowId, RowId>>> matches(fanOut);
+    BlockInfo pbi(0, fanOut, 1);
+    parallel_for(pbi, [&](unsigned rank, uint64_t begin, uint64_t end) {
+        vector<RowId> buckets, chain;
+        for (uint64_t p = begin; p < end; ++p)
+        {
+            const auto buildBegin = buildTuples.data() + buildOffsets[p];
+            const RowId buildSize = buildOffsets[p + 1] - buildOffsets[p];
+            if (buildSize == 0)
+                continue;
+
+            unsigned tableBits = 1;
+            while ((1ull << tableBits) < buildSize)
+                ++tableBits;
+            const unsigned shift = 64 - bits - tableBits;
+            const uint64_t mask = (1ull << tableBits) - 1;
+
+            buckets.assign(1ull << tableBits, endOfChain);
+            chain.resize(buildSize);
+            for (RowId j = 0; j < buildSize; ++j)
+            {
+                auto& bucket = buckets[(hashKey(buildBegin[j].key) >> shift) &
+                                       mask];
+                chain[j] = bucket;
+                bucket = j;
+            }
+
+            auto& partitionMatches = matches[p];
+            for (uint64_t i = probeOffsets[p]; i < probeOffsets[p + 1]; ++i)
+            {
+                const auto& probe = probeTuples[i];
+                for (RowId j = buckets[(hashKey(probe.key) >> shift) & mask];
+                     j != endOfChain; j = chain[j])
+                {
+                    if (buildBegin[j].key == probe.key)
+                        partitionMatches.emplace_back(buildBegin[j].rowId,
+                                                      probe.rowId);
+                }
+            }
+        }
+    });
 
-    resultSize = atmResultSize.load();
+    // Every partition writes its matches behind the ones of its predecessors
+    vector<uint64_t> resultOffsets(fanOut + 1);
+    for (unsigned p = 0; p < fanOut; ++p)
+        resultOffsets[p + 1] = resultOffsets[p] + matches[p].size();
+    resultSize = resultOffsets[fanOut];
     if (resultSize == 0)
         return;
 
-    for (unsigned i = 1; i < rightResultSize - 1; ++i)
-        matchCounts[i + 1] += matchCounts[i];
-
     const unsigned copyLeftSize = copyLeftData.size();
     const unsigned copyRightSize = copyRightData.size();
-    const unsigned copyDataSize = copyLeftSize + copyRightSize;
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        parallel_for(pbi, [this, &matches, &resultOffsets, &rowIds,
+                           copyLeftSize, copyRightSize](
+                              unsigned rank, uint64_t begin, uint64_t end) {
+            for (uint64_t p = begin; p < end; ++p)
+            {
+                uint64_t offset = resultOffsets[p];
+                for (auto& [leftId, rightId] : matches[p])
+                {
+                    unsigned relColId = 0;
+                    for (unsigned cId = 0; cId < copyLeftSize; ++cId)
+                        rowIds[relColId++][offset] = copyLeftData[cId][leftId];
 
-    for (auto& tmpResult : tmpResults)
+                    for (unsigned cId = 0; cId < copyRightSize; ++cId)
+                        rowIds[relColId++][offset] =
+                            copyRightData[cId][rightId];
+                    ++offset;
+                }
+            }
+        });
+    });
+}
+//---------------------------------------------------------------------------
+static uint64_t lowerBound(ColumnView column, uint64_t size, uint64_t key)
+// The first position of a sorted column whose value is not less than key
+{
+    uint64_t first = 0;
+    while (size > 0)
     {
-        tmpResult.resize(resultSize);
+        const uint64_t half = size / 2;
+        if (column[first + half] < key)
+        {
+            first += half + 1;
+            size -= half + 1;
+        }
+        else
+        {
+            size = half;
+        }
     }
+    return first;
+}
+//---------------------------------------------------------------------------
+void Join::runSortMerge(ColumnView leftKeyColumn, ColumnView rightKeyColumn)
+// Merge the inputs, which are sorted by their keys
+{
+    const uint64_t leftSize = left->resultSize;
+    const uint64_t rightSize = right->resultSize;
+    const unsigned copyLeftSize = copyLeftData.size();
+    const unsigned copyRightSize = copyRightData.size();
 
-    parallel_for(
-        bi, [this, &matches, copyLeftSize, copyRightSize, &matchCounts](
-                unsigned rank, uint64_t begin, uint64_t end) {
-            for (uint64_t i = begin; i < end; ++i)
+    // Each block of the left input merges the keys that start in it with
+    // the right input, emit(leftId, rightId) is called for every match
+    auto merge = [=](uint64_t begin, uint64_t end, auto&& emit) {
+        // A key belongs to the block of its first tuple
+        while (begin > 0 && begin < end &&
+               leftKeyColumn[begin - 1] == leftKeyColumn[begin])
+            ++begin;
+        while (end > begin && end < leftSize &&
+               leftKeyColumn[end - 1] == leftKeyColumn[end])
+            ++end;
+        if (begin == end)
+            return;
+
+        uint64_t i = begin;
+        uint64_t j = lowerBound(rightKeyColumn, rightSize, leftKeyColumn[i]);
+        while (i < end && j < rightSize)
+        {
+            const uint64_t leftKey = leftKeyColumn[i];
+            const uint64_t rightKey = rightKeyColumn[j];
+            if (leftKey < rightKey)
+            {
+                ++i;
+            }
+            else if (rightKey < leftKey)
+            {
+                ++j;
+            }
+            else
             {
-                auto& range = matches[i];
-                const auto startOffset = matchCounts[i];
+                uint64_t leftEnd = i + 1, rightEnd = j + 1;
+                while (leftEnd < end && leftKeyColumn[leftEnd] == leftKey)
+                    ++leftEnd;
+                while (rightEnd < rightSize &&
+                       rightKeyColumn[rightEnd] == rightKey)
+                    ++rightEnd;
+                emit(i, leftEnd, j, rightEnd);
+                i = leftEnd;
+                j = rightEnd;
+            }
+        }
+    };
+
+    Materializer materializer(BlockInfo(0, leftSize));
+    materializer.count([&merge](uint64_t begin, uint64_t end,
+                                uint64_t* counts) {
+        uint64_t localResultSize = 0;
+        merge(begin, end, [&](uint64_t leftBegin, uint64_t leftEnd,
+                              uint64_t rightBegin, uint64_t rightEnd) {
+            localResultSize += (leftEnd - leftBegin) * (rightEnd - rightBegin);
+        });
+        counts[0] = localResultSize;
+    });
+
+    resultSize = materializer.size();
+    if (resultSize == 0)
+        return;
+
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        materializer.scatter([this, &merge, &rowIds, copyLeftSize,
+                              copyRightSize](uint64_t begin, uint64_t end,
+                                             const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
+            merge(begin, end, [&](uint64_t leftBegin, uint64_t leftEnd,
+                                  uint64_t rightBegin, uint64_t rightEnd) {
+                for (uint64_t leftId = leftBegin; leftId < leftEnd; ++leftId)
+                {
+                    for (uint64_t rightId = rightBegin; rightId < rightEnd;
+                         ++rightId, ++offset)
+                    {
+                        unsigned relColId = 0;
+                        for (unsigned cId = 0; cId < copyLeftSize; ++cId)
+                            rowIds[relColId++][offset] =
+                                copyLeftData[cId][leftId];
+
+                        for (unsigned cId = 0; cId < copyRightSize; ++cId)
+                            rowIds[relColId++][offset] =
+                                copyRightData[cId][rightId];
+                    }
+                }
+            });
+        });
+    });
+}
+//---------------------------------------------------------------------------
+void Join::runIndexNestedLoop(ColumnView leftKeyColumn,
+                              const SortedIndex& index)
+// Look up the left keys in the sorted index of the right input
+{
+    // The row ids of the right input are the row ids of its relation
+    vector<pair<uint64_t, uint64_t>> matches(left->resultSize);
+    Materializer materializer(BlockInfo(0, left->resultSize));
+    materializer.count([leftKeyColumn, &index, &matches](
+                           uint64_t begin, uint64_t end, uint64_t* counts) {
+        uint64_t localResultSize = 0;
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            matches[i] = index.equalRange(leftKeyColumn[i]);
+            localResultSize += matches[i].second - matches[i].first;
+        }
+        counts[0] = localResultSize;
+    });
 
-                unsigned j = 0;
-                for (auto iter = range.first; iter != range.second; ++iter, ++j)
+    resultSize = materializer.size();
+    if (resultSize == 0)
+        return;
+
+    const unsigned copyLeftSize = copyLeftData.size();
+    const unsigned copyRightSize = copyRightData.size();
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        materializer.scatter([this, &index, &matches, &rowIds, copyLeftSize,
+                              copyRightSize](uint64_t begin, uint64_t end,
+                                             const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
+            for (uint64_t i = begin; i < end; ++i)
+            {
+                for (uint64_t e = matches[i].first; e != matches[i].second;
+                     ++e, ++offset)
                 {
+                    const uint64_t rightId = index.rowIds[e];
                     unsigned relColId = 0;
                     for (unsigned cId = 0; cId < copyLeftSize; ++cId)
-                        tmpResults[relColId++][startOffset + j] =
-                            copyLeftData[cId][iter->second];
+                        rowIds[relColId++][offset] = copyLeftData[cId][i];
 
                     for (unsigned cId = 0; cId < copyRightSize; ++cId)
-                        tmpResults[relColId++][startOffset + j] =
-                            copyRightData[cId][i];
+                        rowIds[relColId++][offset] =
+                            copyRightData[cId][rightId];
                 }
             }
         });
-}
-//---------------------------------------------------------------------------
-void SelfJoin::copy2Result(uint64_t id)
-// Copy to result
-{
-    for (unsigned cId = 0; cId < copyData.size(); ++cId)
-        tmpResults[cId].push_back(copyData[cId][id]);
-    ++resultSize;
+    });
 }
 //---------------------------------------------------------------------------
 bool SelfJoin::require(SelectInfo info)
@@ -289,7 +889,8 @@ bool SelfJoin::require(SelectInfo info)
         return true;
     if (input->require(info))
     {
-        tmpResults.emplace_back();
+        binding2Relation[info.binding] = input->getRelation(info.binding);
+        addRequiredColumn(info);
         requiredIUs.emplace(info);
         return true;
     }
@@ -302,50 +903,43 @@ void SelfJoin::run()
     input->require(pInfo.left);
     input->require(pInfo.right);
     input->run();
-    inputData = input->getResults();
-
-    for (auto& iu : requiredIUs)
-    {
-        auto id = input->resolve(iu);
-        copyData.emplace_back(inputData[id]);
-        select2ResultColId.emplace(iu, copyData.size() - 1);
-    }
-
-    auto leftColId = input->resolve(pInfo.left);
-    auto rightColId = input->resolve(pInfo.right);
-
-    BlockInfo bi(0, input->resultSize);
 
-    std::atomic<uint64_t> atmResultSize = 0;
-    std::vector<std::vector<std::vector<uint64_t>>> subResults(bi.blockCount, tmpResults);
+    copyData.resize(tmpResults.size());
+    for (auto& [binding, colId] : binding2RowIdColId)
+        copyData[colId] = input->getRowIds(binding);
 
-    auto leftCol = inputData[leftColId];
-    auto rightCol = inputData[rightColId];
+    auto leftCol = input->getColumn(pInfo.left);
+    auto rightCol = input->getColumn(pInfo.right);
     const uint64_t copyDataSize = copyData.size();
-    parallel_for(bi, [this, leftCol, rightCol, &atmResultSize, &subResults, copyDataSize](
-                         unsigned rank, uint64_t begin, uint64_t end) {
+
+    // Count the matching rows of each block, then write their row ids
+    // directly to their offsets
+    Materializer materializer(BlockInfo(0, input->resultSize));
+    materializer.count([leftCol, rightCol](uint64_t begin, uint64_t end,
+                                           uint64_t* counts) {
         uint64_t localResultSize = 0;
         for (uint64_t i = begin; i < end; ++i)
-        {
-            if (leftCol[i] == rightCol[i])
+            localResultSize += leftCol[i] == rightCol[i];
+        counts[0] = localResultSize;
+    });
+
+    resultSize = materializer.size();
+    writeRowIds(tmpResults, narrowRowIds(), resultSize, [&](auto rowIds) {
+        materializer.scatter([this, leftCol, rightCol, &rowIds, copyDataSize](
+                                 uint64_t begin, uint64_t end,
+                                 const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
+            for (uint64_t i = begin; i < end; ++i)
             {
-                for (unsigned cId = 0; cId < copyDataSize; ++cId)
-                    subResults[rank][cId].push_back(copyData[cId][i]);
-                ++localResultSize;
+                if (leftCol[i] == rightCol[i])
+                {
+                    for (unsigned cId = 0; cId < copyDataSize; ++cId)
+                        rowIds[cId][offset] = copyData[cId][i];
+                    ++offset;
+                }
             }
-        }
-        std::atomic_fetch_add(&atmResultSize, localResultSize);
+        });
     });
-
-    for (const auto& subResult : subResults)
-    {
-        const unsigned totalSize = tmpResults.size();
-        for (unsigned i = 0; i < totalSize; ++i)
-            tmpResults[i].insert(end(tmpResults[i]), begin(subResult[i]),
-                                 end(subResult[i]));
-    }
-
-    resultSize = atmResultSize.load();
 }
 //---------------------------------------------------------------------------
 void Checksum::run()
@@ -356,22 +950,19 @@ void Checksum::run()
         input->require(sInfo);
     }
     input->run();
-    auto results = input->getResults();
 
     checkSums.resize(colInfo.size());
+    resultSize = input->resultSize;
 
+    // Gather the values of the selected columns from the base relations
     const uint64_t colInfoSize = colInfo.size();
     for (uint64_t i = 0; i < colInfoSize; ++i)
     {
-        auto& sInfo = colInfo[i];
-        auto colId = input->resolve(sInfo);
-        auto resultCol = results[colId];
-        resultSize = input->resultSize;
+        auto resultCol = input->getColumn(colInfo[i]);
 
         uint64_t sum = 0;
-        for (auto iter = resultCol, limit = iter + input->resultSize;
-             iter != limit; ++iter)
-            sum += *iter;
+        for (uint64_t j = 0; j < resultSize; ++j)
+            sum += resultCol[j];
         checkSums[i] = sum;
     }
 }
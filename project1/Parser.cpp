@@ -1,115 +1,136 @@
 #include "Parser.hpp"
-#include <cassert>
+#include <charconv>
 #include <iostream>
 #include <sstream>
+#include <system_error>
 #include <utility>
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
-static void splitString(string& line, vector<unsigned>& result,
-                        const char delimiter)
-// Split a line into numbers
+static void expect(bool valid, string_view text, size_t pos,
+                   const char* expected)
+// Report malformed input
 {
-    stringstream ss(line);
-    string token;
-    while (getline(ss, token, delimiter))
+    if (!valid)
     {
-        result.push_back(stoul(token));
+        cerr << "Malformed query part \"" << text << "\": expected "
+             << expected << " at position " << pos << endl;
+        throw;
     }
 }
 //---------------------------------------------------------------------------
-static void splitString(string& line, vector<string>& result,
-                        const char delimiter)
-// Parse a line into strings
+static uint64_t parseNumber(string_view text, size_t& pos)
+// Parse the number at a position and move behind it
 {
-    stringstream ss(line);
-    string token;
-    while (getline(ss, token, delimiter))
-    {
-        result.push_back(token);
-    }
+    uint64_t value = 0;
+    auto [end, error] =
+        from_chars(text.data() + pos, text.data() + text.size(), value);
+    expect(error == errc(), text, pos, "a number");
+    pos = end - text.data();
+    return value;
 }
 //---------------------------------------------------------------------------
-static void splitPredicates(string& line, vector<string>& result)
-// Split a line into predicate strings
+static void parseSeparator(string_view text, size_t& pos, char separator)
+// Parse a separator at a position and move behind it
 {
-    // Determine predicate type
-    for (auto cT : comparisonTypes)
-    {
-        if (line.find(cT) != string::npos)
-        {
-            splitString(line, result, cT);
-            break;
-        }
-    }
+    const char expected[] = {'\'', separator, '\'', 0};
+    expect(pos < text.size() && text[pos] == separator, text, pos, expected);
+    ++pos;
 }
 //---------------------------------------------------------------------------
-void QueryInfo::parseRelationIds(string& rawRelations)
-// Parse a string of relation ids
+static SelectInfo parseRelColPair(string_view text, size_t& pos)
+// Parse "binding.colId" at a position and move behind it
 {
-    splitString(rawRelations, relationIds, ' ');
+    const unsigned binding = parseNumber(text, pos);
+    parseSeparator(text, pos, '.');
+    const unsigned colId = parseNumber(text, pos);
+    return SelectInfo(0, binding, colId);
 }
 //---------------------------------------------------------------------------
-static SelectInfo parseRelColPair(string& raw)
+static void skipDelimiters(string_view text, size_t& pos, char delimiter)
+// Move behind the delimiters at a position
 {
-    vector<unsigned> ids;
-    splitString(raw, ids, '.');
-    return SelectInfo(0, ids[0], ids[1]);
+    while (pos < text.size() && text[pos] == delimiter)
+        ++pos;
 }
 //---------------------------------------------------------------------------
-inline static bool isConstant(string& raw)
+void QueryInfo::parseRelationIds(string_view rawRelations)
+// Parse a string of relation ids
 {
-    return raw.find('.') == string::npos;
+    size_t pos = 0;
+    skipDelimiters(rawRelations, pos, ' ');
+    while (pos < rawRelations.size())
+    {
+        relationIds.push_back(parseNumber(rawRelations, pos));
+        if (pos < rawRelations.size())
+            parseSeparator(rawRelations, pos, ' ');
+        skipDelimiters(rawRelations, pos, ' ');
+    }
 }
 //---------------------------------------------------------------------------
-void QueryInfo::parsePredicate(string& rawPredicate)
+void QueryInfo::parsePredicate(string_view rawPredicates, size_t& pos)
 // Parse a single predicate: join "r1Id.col1Id=r2Id.col2Id" or
 // "r1Id.col1Id=constant" filter
 {
-    vector<string> relCols;
-    splitPredicates(rawPredicate, relCols);
-    assert(relCols.size() == 2);
-    assert(!isConstant(relCols[0]) &&
-           "left side of a predicate is always a SelectInfo");
-    auto leftSelect = parseRelColPair(relCols[0]);
-    if (isConstant(relCols[1]))
+    auto leftSelect = parseRelColPair(rawPredicates, pos);
+    expect(pos < rawPredicates.size() &&
+               (rawPredicates[pos] == FilterInfo::Less ||
+                rawPredicates[pos] == FilterInfo::Greater ||
+                rawPredicates[pos] == FilterInfo::Equal),
+           rawPredicates, pos, "a comparison");
+    const char compType = rawPredicates[pos++];
+
+    // The right side is a constant unless a column id follows
+    const uint64_t number = parseNumber(rawPredicates, pos);
+    if (pos < rawPredicates.size() && rawPredicates[pos] == '.')
     {
-        uint64_t constant = stoul(relCols[1]);
-        char compType = rawPredicate[relCols[0].size()];
-        filters.emplace_back(leftSelect, constant,
-                             FilterInfo::Comparison(compType));
+        expect(compType == '=', rawPredicates, pos, "a constant");
+        ++pos;
+        const unsigned colId = parseNumber(rawPredicates, pos);
+        predicates.emplace_back(leftSelect, SelectInfo(0, number, colId));
     }
     else
     {
-        predicates.emplace_back(leftSelect, parseRelColPair(relCols[1]));
+        filters.emplace_back(leftSelect, number,
+                             FilterInfo::Comparison(compType));
     }
 }
 //---------------------------------------------------------------------------
-void QueryInfo::parsePredicates(string& text)
+void QueryInfo::parsePredicates(string_view text)
 // Parse predicates
 {
-    vector<string> predicateStrings;
-    splitString(text, predicateStrings, '&');
-    for (auto& rawPredicate : predicateStrings)
+    size_t pos = 0;
+    while (pos < text.size())
     {
-        parsePredicate(rawPredicate);
+        parsePredicate(text, pos);
+        if (pos < text.size())
+            parseSeparator(text, pos, '&');
+        skipDelimiters(text, pos, '&');
     }
 }
 //---------------------------------------------------------------------------
-void QueryInfo::parseSelections(string& rawSelections)
+void QueryInfo::parseSelections(string_view rawSelections)
 // Parse selections
 {
-    vector<string> selectionStrings;
-    splitString(rawSelections, selectionStrings, ' ');
-    for (auto& rawSelect : selectionStrings)
+    size_t pos = 0;
+    skipDelimiters(rawSelections, pos, ' ');
+    while (pos < rawSelections.size())
     {
-        selections.emplace_back(parseRelColPair(rawSelect));
+        selections.emplace_back(parseRelColPair(rawSelections, pos));
+        if (pos < rawSelections.size())
+            parseSeparator(rawSelections, pos, ' ');
+        skipDelimiters(rawSelections, pos, ' ');
     }
 }
 //---------------------------------------------------------------------------
 static void resolveIds(vector<unsigned>& relationIds, SelectInfo& selectInfo)
 // Resolve relation id
 {
+    if (selectInfo.binding >= relationIds.size())
+    {
+        cerr << "Binding " << selectInfo.binding << " does not exist" << endl;
+        throw;
+    }
     selectInfo.relId = relationIds[selectInfo.binding];
 }
 //---------------------------------------------------------------------------
@@ -134,16 +155,19 @@ void QueryInfo::resolveRelationIds()
     }
 }
 //---------------------------------------------------------------------------
-void QueryInfo::parseQuery(string& rawQuery)
+void QueryInfo::parseQuery(string_view rawQuery)
 // Parse query [RELATIONS]|[PREDICATES]|[SELECTS]
 {
+    // The parts are views of the query, and the vectors keep their capacity
+    // when a query info is reused, so parsing does not allocate
     clear();
-    vector<string> queryParts;
-    splitString(rawQuery, queryParts, '|');
-    assert(queryParts.size() == 3);
-    parseRelationIds(queryParts[0]);
-    parsePredicates(queryParts[1]);
-    parseSelections(queryParts[2]);
+    const size_t first = rawQuery.find('|');
+    const size_t second = rawQuery.find('|', first + 1);
+    expect(first != string_view::npos, rawQuery, rawQuery.size(), "'|'");
+    expect(second != string_view::npos, rawQuery, rawQuery.size(), "'|'");
+    parseRelationIds(rawQuery.substr(0, first));
+    parsePredicates(rawQuery.substr(first + 1, second - first - 1));
+    parseSelections(rawQuery.substr(second + 1));
     resolveRelationIds();
 }
 //---------------------------------------------------------------------------
@@ -277,7 +301,7 @@ string QueryInfo::dumpSQL()
     return sql.str();
 }
 //---------------------------------------------------------------------------
-QueryInfo::QueryInfo(string rawQuery)
+QueryInfo::QueryInfo(string_view rawQuery)
 {
     parseQuery(rawQuery);
 }
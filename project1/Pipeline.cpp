@@ -0,0 +1,547 @@
+#include "Pipeline.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <set>
+#include <sstream>
+#include "BatchCache.hpp"
+#include "FilterKernels.hpp"
+#include "Operators.hpp"
+#include "Planner.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// The number of scanned tuples a worker takes at once (a multiple of the
+/// kernel block size)
+static constexpr unsigned morselSize = 1u << 14;
+/// The number of tuples of a batch
+static constexpr unsigned batchSize = FilterKernels::blockSize;
+//---------------------------------------------------------------------------
+Pipeline::Column Pipeline::resolve(const SelectInfo& info)
+// Resolve a column of the query
+{
+    return Column{ relations[info.relId].column(info.colId), info.binding };
+}
+//---------------------------------------------------------------------------
+Pipeline::Plan Pipeline::choosePlan()
+// Choose the scanned relation and the order of the probes
+{
+    Planner planner(relations);
+    auto cardinalities = planner.estimateCardinalities(query);
+
+    // The largest relation is scanned, all others end up in hash tables
+    Plan result{ 0, {} };
+    for (unsigned b = 1; b < cardinalities.size(); ++b)
+        if (cardinalities[b] > cardinalities[result.sourceBinding])
+            result.sourceBinding = b;
+
+    set<unsigned> bound{ result.sourceBinding };
+    while (true)
+    {
+        // Probe the relation with the smallest expected fan-out next,
+        // predicates within the bound relations become checks
+        unsigned best = query.predicates.size();
+        double bestFanOut = 0;
+        for (unsigned p = 0; p < query.predicates.size(); ++p)
+        {
+            auto& predicate = query.predicates[p];
+            bool leftBound = bound.count(predicate.left.binding);
+            bool rightBound = bound.count(predicate.right.binding);
+            if (leftBound == rightBound)
+                continue;
+            auto binding =
+                leftBound ? predicate.right.binding : predicate.left.binding;
+            double fanOut = cardinalities[binding] *
+                            planner.estimateSelectivity(predicate,
+                                                        cardinalities);
+            if (best == query.predicates.size() || fanOut < bestFanOut)
+            {
+                best = p;
+                bestFanOut = fanOut;
+            }
+        }
+        if (best == query.predicates.size())
+            break;
+
+        result.probes.push_back(best);
+        bound.insert(query.predicates[best].left.binding);
+        bound.insert(query.predicates[best].right.binding);
+    }
+    return result;
+}
+//---------------------------------------------------------------------------
+void Pipeline::plan()
+// Build the probe steps of the plan
+{
+    // The plan only depends on the query and the statistics, so repeated
+    // queries reuse it
+    shared_ptr<const Plan> chosen;
+    if (planCache)
+        chosen = planCache->get<Plan>("pipeline " + query.dumpText(), [this] {
+            return make_shared<const Plan>(choosePlan());
+        });
+    else
+        chosen = make_shared<const Plan>(choosePlan());
+
+    sourceBinding = chosen->sourceBinding;
+    for (auto& f : query.filters)
+        if (f.filterColumn.binding == sourceBinding)
+            sourceFilters.push_back(f);
+
+    set<unsigned> bound{ sourceBinding };
+    vector<bool> used(query.predicates.size());
+    for (unsigned s = 0;; ++s)
+    {
+        // Predicates within the bound relations become checks
+        auto& checks = steps.empty() ? sourceChecks : steps.back().checks;
+        for (unsigned p = 0; p < query.predicates.size(); ++p)
+        {
+            auto& predicate = query.predicates[p];
+            if (!used[p] && bound.count(predicate.left.binding) &&
+                bound.count(predicate.right.binding))
+            {
+                checks.push_back(
+                    Check{ resolve(predicate.left), resolve(predicate.right) });
+                used[p] = true;
+            }
+        }
+        if (s == chosen->probes.size())
+            break;
+
+        auto& probe = query.predicates[chosen->probes[s]];
+        used[chosen->probes[s]] = true;
+        bool leftBound = bound.count(probe.left.binding);
+        auto& buildColumn = leftBound ? probe.right : probe.left;
+        auto& probeColumn = leftBound ? probe.left : probe.right;
+        steps.push_back(ProbeStep{ buildColumn.binding, buildColumn,
+                                   probeColumn, resolve(probeColumn), {}, {},
+                                   {} });
+        bound.insert(buildColumn.binding);
+    }
+    // We never have cross products
+    assert(find(used.begin(), used.end(), false) == used.end());
+
+    for (auto& sInfo : query.selections)
+        selections.push_back(resolve(sInfo));
+
+    firstAggregated = steps.size();
+    if (factorize)
+        factorizeSteps();
+    // Every step copies the row ids of the bound bindings to its output
+    vector<unsigned> boundBindings{ sourceBinding };
+    for (auto& step : steps)
+    {
+        step.boundBindings = boundBindings;
+        boundBindings.push_back(step.binding);
+    }
+    for (unsigned i = 0; i < selections.size(); ++i)
+    {
+        bool aggregated = false;
+        for (unsigned s = firstAggregated; s < steps.size(); ++s)
+            aggregated |= selections[i].binding == steps[s].binding;
+        if (!aggregated)
+            enumeratedSelections.push_back(i);
+    }
+}
+//---------------------------------------------------------------------------
+void Pipeline::factorizeSteps()
+// Move the steps whose relation can be aggregated to the end
+{
+    // Only the row ids of relations that are probed with or checked are
+    // needed, all other relations just contribute counts and sums
+    set<unsigned> referenced;
+    for (auto& step : steps)
+    {
+        referenced.insert(step.probeColumn.binding);
+        for (auto& c : step.checks)
+        {
+            referenced.insert(c.left.binding);
+            referenced.insert(c.right.binding);
+        }
+    }
+    for (auto& step : steps)
+        step.aggregated = !referenced.count(step.binding);
+
+    // Nothing depends on the aggregated steps, so they can be probed last
+    auto firstAggregatedStep = stable_partition(
+        steps.begin(), steps.end(),
+        [](const ProbeStep& step) { return !step.aggregated; });
+    firstAggregated = firstAggregatedStep - steps.begin();
+    for (unsigned s = firstAggregated; s < steps.size(); ++s)
+        for (unsigned i = 0; i < selections.size(); ++i)
+            if (selections[i].binding == steps[s].binding)
+                steps[s].sumSelections.push_back(i);
+}
+//---------------------------------------------------------------------------
+void Pipeline::build(ProbeStep& step)
+// Get the hash table of a probe step
+{
+    // The hash table only depends on the build relation, its filters, its
+    // key and the summed columns
+    stringstream key;
+    if (cache)
+    {
+        key << "hash "
+            << BatchCache::canonicalFilters(step.buildColumn.relId,
+                                            step.binding, query.filters)
+            << " key c" << step.buildColumn.colId;
+        if (step.aggregated)
+        {
+            key << " sums";
+            for (auto i : step.sumSelections)
+                key << " c" << query.selections[i].colId;
+        }
+        step.hashTable = cache->get<HashTable>(
+            key.str(), [this, &step] { return buildHashTable(step); });
+    }
+    else
+    {
+        step.hashTable = buildHashTable(step);
+    }
+
+    // Sideways information passing: the scan drops tuples early if at least
+    // half of its distinct keys cannot find a partner. The filter only
+    // depends on the hash table, so it is shared like the table.
+    auto& table = step.hashTable->table;
+    auto& source = relations[query.relationIds[sourceBinding]];
+    if (step.probeInfo.binding == sourceBinding &&
+        !source.statistics.empty() &&
+        table.size() * 2 < source.statistics[step.probeInfo.colId].distinct)
+    {
+        auto buildBloomFilter = [&table] {
+            auto bloomFilter = make_shared<BloomFilter>(table.size());
+            parallel_for(BlockInfo(0, table.size()),
+                         [&table, &bloomFilter](unsigned, uint64_t begin,
+                                                uint64_t end) {
+                             for (uint64_t e = begin; e < end; ++e)
+                                 bloomFilter->insertConcurrent(table[e].key);
+                         });
+            return bloomFilter;
+        };
+        if (cache)
+            step.bloomFilter =
+                cache->get<BloomFilter>(key.str() + " bloom", buildBloomFilter);
+        else
+            step.bloomFilter = buildBloomFilter();
+    }
+}
+//---------------------------------------------------------------------------
+shared_ptr<Pipeline::HashTable> Pipeline::buildHashTable(
+    const ProbeStep& step)
+// Build the hash table of a probe step
+{
+    auto& relation = relations[step.buildColumn.relId];
+    vector<FilterInfo> filters;
+    for (auto& f : query.filters)
+        if (f.filterColumn.binding == step.binding)
+            filters.push_back(f);
+
+    // The qualifying rows of the build side
+    uint64_t size = relation.size;
+    RowIds rowIds;
+    unique_ptr<FilterScan> scan;
+    if (!filters.empty())
+    {
+        scan = make_unique<FilterScan>(relation, filters);
+        scan->setCache(cache);
+        scan->run();
+        size = scan->resultSize;
+        rowIds = scan->getRowIds(step.binding);
+    }
+
+    // The tables are built in parallel, the duplicates of a key end up
+    // adjacent. The statistics bound the keys, so dense keys are known to be
+    // dense before the build.
+    auto result = make_shared<HashTable>();
+    ColumnView keys = relation.column(step.buildColumn.colId, rowIds);
+    if (relation.statistics.empty())
+    {
+        result->table.build(keys, size, rowIds);
+    }
+    else
+    {
+        auto& statistics = relation.statistics[step.buildColumn.colId];
+        JoinHashTable<uint32_t>::KeyDomain domain{ statistics.min,
+                                                   statistics.max };
+        result->table.build(keys, size, rowIds, &domain);
+    }
+    if (step.aggregated)
+        aggregate(step, *result);
+    return result;
+}
+//---------------------------------------------------------------------------
+void Pipeline::aggregate(const ProbeStep& step, HashTable& ht) const
+// Aggregate the tuples of a hash table per key
+{
+    // The tuples of a key are adjacent, so every run of equal keys is a
+    // group. Every block of entries counts the groups that start in it.
+    auto& tuples = ht.table;
+    BlockInfo bi(0, tuples.size());
+    vector<uint64_t> firstGroup(bi.blockCount + 1);
+    parallel_for(bi, [&tuples, &firstGroup](unsigned rank, uint64_t begin,
+                                            uint64_t end) {
+        uint64_t starts = 0;
+        for (uint64_t e = begin; e < end; ++e)
+            starts += e == 0 || tuples[e - 1].key != tuples[e].key;
+        firstGroup[rank + 1] = starts;
+    });
+    for (unsigned b = 0; b < bi.blockCount; ++b)
+        firstGroup[b + 1] += firstGroup[b];
+    const uint64_t numGroups = firstGroup[bi.blockCount];
+
+    // Every block sums up its part of the groups, the groups that span
+    // several blocks get the partial results of each of them
+    const unsigned numSums = step.sumSelections.size();
+    ht.counts.assign(numGroups, 0);
+    ht.sums.assign(numGroups * numSums, 0);
+    parallel_for(bi, [this, &step, &ht, &tuples, &firstGroup, numSums](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        // The group of the entry before the block, if it continues here
+        uint64_t group = firstGroup[rank] - 1;
+        vector<uint64_t> partial(numSums);
+        for (uint64_t e = begin; e < end;)
+        {
+            if (e == 0 || tuples[e - 1].key != tuples[e].key)
+                ++group;
+            uint64_t count = 0;
+            fill(partial.begin(), partial.end(), 0);
+            const uint64_t key = tuples[e].key;
+            for (; e < end && tuples[e].key == key; ++e, ++count)
+            {
+                const uint64_t rowId = tuples[e].rowId;
+                for (unsigned t = 0; t < numSums; ++t)
+                    partial[t] +=
+                        selections[step.sumSelections[t]].data.value(rowId);
+            }
+            __atomic_fetch_add(&ht.counts[group], count, __ATOMIC_RELAXED);
+            for (unsigned t = 0; t < numSums; ++t)
+                __atomic_fetch_add(&ht.sums[group * numSums + t], partial[t],
+                                   __ATOMIC_RELAXED);
+        }
+    });
+
+    // One entry per key is left, the groups are numbered like the entries
+    tuples.removeDuplicates();
+}
+//---------------------------------------------------------------------------
+bool Pipeline::passes(const vector<Check>& checks, const Batch& batch,
+                      unsigned i)
+// Evaluate checks on a tuple of a batch
+{
+    for (auto& c : checks)
+    {
+        if (c.left.data.value(batch.rowIds[c.left.binding][i]) !=
+            c.right.data.value(batch.rowIds[c.right.binding][i]))
+            return false;
+    }
+    return true;
+}
+//---------------------------------------------------------------------------
+void Pipeline::consume(unsigned stepId, LocalState& state)
+// Probe the input batch of a step and push the matches into the next batch
+{
+    // The whole batch is probed first, in groups whose directory slots and
+    // first entries are prefetched, so their cache misses overlap
+    auto& input = state.batches[stepId];
+    auto probe = [this, &input, &state](unsigned s) {
+        auto& column = steps[s].probeColumn;
+        steps[s].hashTable->table.probe(
+            ColumnView{ column.data.base, input.rowIds[column.binding].data(),
+                        column.data.codes },
+            0, input.count, state.ranges[s].data());
+    };
+
+    // The aggregated steps find a single group per tuple, they are probed
+    // together and summed up right away
+    if (stepId == firstAggregated)
+    {
+        for (unsigned s = firstAggregated; s < steps.size(); ++s)
+            probe(s);
+        sum(state);
+        input.count = 0;
+        return;
+    }
+
+    auto& step = steps[stepId];
+    auto& table = step.hashTable->table;
+    auto& ranges = state.ranges[stepId];
+    probe(stepId);
+    auto& output = state.batches[stepId + 1];
+    auto& buildRowIds = output.rowIds[step.binding];
+    for (unsigned i = 0; i < input.count; ++i)
+    {
+        const auto range = ranges[i];
+        for (uint64_t e = range.offset, limit = e + range.count; e != limit;
+             ++e)
+        {
+            const unsigned o = output.count;
+            for (auto b : step.boundBindings)
+                output.rowIds[b][o] = input.rowIds[b][i];
+            buildRowIds[o] = table[e].rowId;
+            if (!step.checks.empty() && !passes(step.checks, output, o))
+                continue;
+            if (++output.count == batchSize)
+                consume(stepId + 1, state);
+        }
+    }
+    if (output.count)
+        consume(stepId + 1, state);
+    input.count = 0;
+}
+//---------------------------------------------------------------------------
+void Pipeline::sum(LocalState& state)
+// Add the tuples of the input batch of the aggregated steps to the checksum
+{
+    auto& batch = state.batches[firstAggregated];
+    for (unsigned i = 0; i < batch.count; ++i)
+    {
+        // The tuple joins with count tuples of each aggregated relation (the
+        // group of a key is the position of its entry)
+        uint64_t multiplicity = 1;
+        for (unsigned s = firstAggregated; s < steps.size(); ++s)
+        {
+            const auto range = state.ranges[s][i];
+            if (range.count == 0)
+            {
+                multiplicity = 0;
+                break;
+            }
+            multiplicity *= steps[s].hashTable->counts[range.offset];
+        }
+        if (multiplicity == 0)
+            continue;
+
+        // Enumerated values occur once per combination of aggregated tuples
+        for (auto t : enumeratedSelections)
+            state.sums[t] +=
+                selections[t].data.value(
+                    batch.rowIds[selections[t].binding][i]) *
+                multiplicity;
+        // Aggregated sums occur once per combination of the other relations
+        for (unsigned s = firstAggregated; s < steps.size(); ++s)
+        {
+            auto& step = steps[s];
+            uint64_t others = 1;
+            for (unsigned o = firstAggregated; o < steps.size(); ++o)
+                if (o != s)
+                    others *= steps[o].hashTable->counts
+                                  [state.ranges[o][i].offset];
+            const uint64_t group = state.ranges[s][i].offset;
+            const unsigned numSums = step.sumSelections.size();
+            for (unsigned t = 0; t < numSums; ++t)
+                state.sums[step.sumSelections[t]] +=
+                    step.hashTable->sums[group * numSums + t] * others;
+        }
+        state.count += multiplicity;
+    }
+}
+//---------------------------------------------------------------------------
+void Pipeline::run()
+// Run
+{
+    plan();
+    checkSums.assign(selections.size(), 0);
+
+    // Pipeline breakers: all hash tables are built first
+    for (auto& step : steps)
+    {
+        build(step);
+        if (step.hashTable->table.size() == 0)
+            return;
+    }
+
+    auto& relation = relations[query.relationIds[sourceBinding]];
+    // The qualifying rows of the source may be known from a shared scan
+    shared_ptr<const RowIdColumn> sourceRowIds;
+    if (cache && !sourceFilters.empty())
+        sourceRowIds = cache->find<RowIdColumn>(BatchCache::scanKey(
+            query.relationIds[sourceBinding], sourceBinding, sourceFilters));
+
+    const uint64_t sourceSize =
+        sourceRowIds ? sourceRowIds->size() : relation.size;
+    // Every worker sets up its state once and then takes morsels until none
+    // are left, so a morsel only costs an atomic increment. The partial
+    // results are merged once per worker.
+    const uint64_t numMorsels = (sourceSize + morselSize - 1) / morselSize;
+    BlockInfo workers(0, numMorsels, 1);
+    vector<LocalState> states(workers.blockCount);
+    atomic<uint64_t> nextMorsel = 0;
+    parallel_for(workers, [this, &relation, &sourceRowIds, &states,
+                           &nextMorsel, numMorsels, sourceSize](
+                              unsigned rank, uint64_t, uint64_t) {
+        uint64_t morsel = nextMorsel.fetch_add(1, memory_order_relaxed);
+        if (morsel >= numMorsels)
+            return;
+        auto& state = states[rank];
+        state.batches.resize(firstAggregated + 1);
+        for (auto& batch : state.batches)
+            batch.rowIds.assign(query.relationIds.size(),
+                                vector<uint32_t>(FilterKernels::selectionSize));
+        state.ranges.assign(steps.size(),
+                            vector<JoinHashTable<uint32_t>::Range>(batchSize));
+        state.sums.resize(selections.size());
+        for (; morsel < numMorsels;
+             morsel = nextMorsel.fetch_add(1, memory_order_relaxed))
+        {
+            const uint64_t begin = morsel * morselSize;
+            scan(relation, sourceRowIds.get(), begin,
+                 min(sourceSize, begin + morselSize), state);
+        }
+    });
+
+    for (auto& state : states)
+    {
+        for (unsigned s = 0; s < state.sums.size(); ++s)
+            checkSums[s] += state.sums[s];
+        resultSize += state.count;
+    }
+}
+//---------------------------------------------------------------------------
+void Pipeline::scan(Relation& relation, const RowIdColumn* sourceRowIds,
+                    uint64_t begin, uint64_t end, LocalState& state)
+// Push a morsel of the source through the pipeline
+{
+    // The selection of the source is the first batch
+    auto& source = state.batches[0];
+    uint32_t* selection = source.rowIds[sourceBinding].data();
+    // The shared row ids of the source are 32 bit as well
+    const uint32_t* sourceSelection =
+        sourceRowIds ? sourceRowIds->view().narrow : nullptr;
+    assert(!sourceRowIds || sourceSelection);
+    // The blocks are aligned to the zones of the zone maps
+    for (uint64_t i = begin, blockEnd; i < end; i = blockEnd)
+    {
+        blockEnd = min<uint64_t>(end, (i / FilterKernels::blockSize + 1) *
+                                          FilterKernels::blockSize);
+        unsigned count = blockEnd - i;
+        if (sourceRowIds)
+            copy(sourceSelection + i, sourceSelection + blockEnd, selection);
+        else
+            count = FilterKernels::select(relation, sourceFilters, i, blockEnd,
+                                          selection);
+        for (auto& step : steps)
+            if (step.bloomFilter)
+                count = step.bloomFilter->filter(step.probeColumn.data,
+                                                 selection, count);
+        source.count = 0;
+        for (unsigned j = 0; j < count; ++j)
+        {
+            selection[source.count] = selection[j];
+            source.count += passes(sourceChecks, source, source.count);
+        }
+        if (source.count)
+            consume(0, state);
+    }
+}
+//---------------------------------------------------------------------------
+bool Pipeline::supports(const vector<Relation>& relations,
+                        const QueryInfo& query)
+// Can the pipeline run the query?
+{
+    for (auto relId : query.relationIds)
+        if (relations[relId].size > UINT32_MAX)
+            return false;
+    return true;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,176 @@
+#include "Planner.hpp"
+#include <algorithm>
+#include <limits>
+#include <set>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// Selectivities that are assumed when no statistics are available
+static constexpr double defaultEqualSelectivity = 0.1;
+static constexpr double defaultRangeSelectivity = 1.0 / 3;
+//---------------------------------------------------------------------------
+double Planner::estimateSelectivity(const ColumnStatistics& stats,
+                                    const FilterInfo& f)
+// Estimate the selectivity of a filter from the column statistics
+{
+    switch (f.comparison)
+    {
+        case FilterInfo::Comparison::Equal:
+            return stats.estimateEqual(f.constant);
+        case FilterInfo::Comparison::Less:
+            return stats.estimateLess(f.constant);
+        case FilterInfo::Comparison::Greater:
+            return stats.estimateGreater(f.constant);
+    }
+    return 1;
+}
+//---------------------------------------------------------------------------
+double Planner::estimateSelectivity(const FilterInfo& f)
+// Estimate the selectivity of a filter
+{
+    auto& relation = relations[f.filterColumn.relId];
+    if (relation.statistics.empty())
+        return f.comparison == FilterInfo::Comparison::Equal
+                   ? defaultEqualSelectivity
+                   : defaultRangeSelectivity;
+    return estimateSelectivity(relation.statistics[f.filterColumn.colId], f);
+}
+//---------------------------------------------------------------------------
+double Planner::estimateDistinct(const SelectInfo& info, double cardinality)
+// Estimate the number of distinct values of a column after filtering
+{
+    auto& relation = relations[info.relId];
+    if (relation.statistics.empty())
+        return max(cardinality, 1.0);
+    double distinct = relation.statistics[info.colId].distinct;
+    return max(min(distinct, cardinality), 1.0);
+}
+//---------------------------------------------------------------------------
+double Planner::estimateSelectivity(const PredicateInfo& p,
+                                    const vector<double>& cardinalities)
+// Estimate the selectivity of a join predicate
+{
+    // Every value of the column with fewer distinct values finds a partner
+    auto leftDistinct = estimateDistinct(p.left, cardinalities[p.left.binding]);
+    auto rightDistinct =
+        estimateDistinct(p.right, cardinalities[p.right.binding]);
+    return 1.0 / max(leftDistinct, rightDistinct);
+}
+//---------------------------------------------------------------------------
+vector<double> Planner::estimateCardinalities(const QueryInfo& query)
+// Estimate the cardinality of every binding after applying its filters
+{
+    vector<double> cardinalities;
+    for (auto relId : query.relationIds)
+        cardinalities.push_back(relations[relId].size);
+    for (auto& f : query.filters)
+        cardinalities[f.filterColumn.binding] *= estimateSelectivity(f);
+    return cardinalities;
+}
+//---------------------------------------------------------------------------
+static void orient(PredicateInfo& p, bool leftIsBuild)
+// Make sure that the build side is the left side of the predicate
+{
+    if (!leftIsBuild)
+        swap(p.left, p.right);
+}
+//---------------------------------------------------------------------------
+void Planner::orderJoins(QueryInfo& query)
+// Order the join predicates of a query and choose their build sides
+{
+    auto cardinalities = estimateCardinalities(query);
+    vector<PredicateInfo> remaining = query.predicates;
+    vector<PredicateInfo> ordered;
+    set<unsigned> joined;
+
+    // Start with the join that has the smallest estimated result
+    auto best = remaining.end();
+    double cardinality = numeric_limits<double>::infinity();
+    for (auto it = remaining.begin(); it != remaining.end(); ++it)
+    {
+        if (it->left.binding == it->right.binding)
+            continue;
+        double estimate = cardinalities[it->left.binding] *
+                          cardinalities[it->right.binding] *
+                          estimateSelectivity(*it, cardinalities);
+        if (estimate < cardinality)
+        {
+            cardinality = estimate;
+            best = it;
+        }
+    }
+    if (best == remaining.end())
+        return;
+
+    orient(*best, cardinalities[best->left.binding] <=
+                      cardinalities[best->right.binding]);
+    joined.insert(best->left.binding);
+    joined.insert(best->right.binding);
+    ordered.push_back(*best);
+    remaining.erase(best);
+
+    while (!remaining.empty())
+    {
+        // Predicates within the joined relations are evaluated right away
+        for (auto it = remaining.begin(); it != remaining.end();)
+        {
+            if (joined.count(it->left.binding) &&
+                joined.count(it->right.binding))
+            {
+                cardinality *= estimateSelectivity(*it, cardinalities);
+                ordered.push_back(*it);
+                it = remaining.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // Greedily add the relation that leads to the smallest result
+        unsigned bestBinding = 0;
+        double bestCardinality = numeric_limits<double>::infinity();
+        best = remaining.end();
+        for (auto it = remaining.begin(); it != remaining.end(); ++it)
+        {
+            bool leftJoined = joined.count(it->left.binding);
+            bool rightJoined = joined.count(it->right.binding);
+            if (leftJoined == rightJoined)
+                continue;
+
+            unsigned binding = leftJoined ? it->right.binding
+                                          : it->left.binding;
+            double estimate = cardinality * cardinalities[binding];
+            for (auto& p : remaining)
+            {
+                if ((p.left.binding == binding &&
+                     joined.count(p.right.binding)) ||
+                    (p.right.binding == binding &&
+                     joined.count(p.left.binding)))
+                    estimate *= estimateSelectivity(p, cardinalities);
+            }
+            if (estimate < bestCardinality)
+            {
+                bestCardinality = estimate;
+                bestBinding = binding;
+                best = it;
+            }
+        }
+        if (best == remaining.end())
+            break;
+
+        // Build on the new relation if it is smaller than the intermediate
+        bool newIsBuild = cardinalities[bestBinding] < cardinality;
+        orient(*best, (best->left.binding == bestBinding) == newIsBuild);
+        joined.insert(bestBinding);
+        cardinality *= cardinalities[bestBinding] *
+                       estimateSelectivity(*best, cardinalities);
+        ordered.push_back(*best);
+        remaining.erase(best);
+    }
+
+    // Predicates that are not connected to the others keep their order
+    ordered.insert(ordered.end(), remaining.begin(), remaining.end());
+    query.predicates = move(ordered);
+}
+//---------------------------------------------------------------------------
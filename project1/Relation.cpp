@@ -2,26 +2,270 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
 #include <fstream>
 #include <iostream>
+#include "ThreadPool.hpp"
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
+/// The header of a relation file (format version 2). It is followed by one
+/// segment descriptor per column, the column segments and the footer with
+/// the statistics and the zone maps of all columns.
+struct RelationFileHeader
+{
+    /// Identifies relation files, the legacy layout starts with the size
+    static constexpr uint64_t magic = 0x32454c49464c4552ull;  // "RELFILE2"
+    /// The current format version
+    static constexpr uint32_t currentVersion = 2;
+
+    uint64_t fileMagic;
+    /// The format version
+    uint32_t version;
+    /// The number of columns
+    uint32_t numColumns;
+    /// The number of tuples
+    uint64_t size;
+    /// The position and the length of the footer (in bytes)
+    uint64_t footerOffset, footerLength;
+    /// The checksum of the footer
+    uint64_t footerChecksum;
+    /// Unused, must be zero
+    uint64_t reserved;
+    /// The checksum of the header (up to here) and the segment descriptors
+    uint64_t checksum;
+};
+static_assert(sizeof(RelationFileHeader) == 64, "header is one cache line");
+/// The encoding of a column segment
+enum class SegmentEncoding : uint64_t
+{
+    /// Uncompressed 64 bit values
+    Raw = 0,
+    /// Codes of a compressed column (frame of reference)
+    FrameOfReference = 1,
+    /// Codes of a compressed column (dictionary)
+    Dictionary = 2,
+};
+/// The location of a column segment
+struct SegmentDescriptor
+{
+    /// The position and the length of the segment (in bytes)
+    uint64_t offset, length;
+    /// The encoding of the values
+    SegmentEncoding encoding;
+};
+/// The start of a compressed segment, it is followed by the dictionary (if
+/// any) and the codes
+struct CompressedSegmentHeader
+{
+    /// The size of a code (in bytes)
+    uint64_t width;
+    /// The largest code
+    uint64_t maxCode;
+    /// The smallest value (frame of reference)
+    uint64_t base;
+    /// The number of values of the dictionary
+    uint64_t dictionarySize;
+};
+/// The alignment of column segments, segments of at least a huge page are
+/// aligned to huge pages so that they can be mapped with them
+static constexpr uint64_t segmentAlignment = 64;
+static constexpr uint64_t hugePageSize = 2ull << 20;
+//---------------------------------------------------------------------------
+static uint64_t alignUp(uint64_t offset, uint64_t alignment)
+// Round up an offset to a power of two alignment
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+//---------------------------------------------------------------------------
+static uint64_t checksum(const void* data, uint64_t length,
+                         uint64_t hash = 0xcbf29ce484222325ull)
+// FNV-1a checksum of a byte range, continues the given hash
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (uint64_t i = 0; i < length; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+//---------------------------------------------------------------------------
+static uint64_t headerChecksum(const RelationFileHeader& header,
+                               const SegmentDescriptor* segments)
+// Checksum of the header and the segment descriptors
+{
+    uint64_t hash = checksum(&header, offsetof(RelationFileHeader, checksum));
+    return checksum(segments, header.numColumns * sizeof(SegmentDescriptor),
+                    hash);
+}
+//---------------------------------------------------------------------------
+static void appendVector(vector<uint64_t>& footer, const vector<uint64_t>& v)
+// Append a vector and its length to the footer
+{
+    footer.push_back(v.size());
+    footer.insert(footer.end(), v.begin(), v.end());
+}
+//---------------------------------------------------------------------------
+/// Reads the words of a footer with bounds checks
+struct FooterReader
+{
+    /// The next word and the end of the footer
+    const uint64_t *pos, *end;
+
+    /// Read a word, false if the footer is exhausted
+    bool read(uint64_t& value)
+    {
+        if (pos == end)
+            return false;
+        value = *pos++;
+        return true;
+    }
+    /// Read a vector with its length
+    bool read(vector<uint64_t>& v)
+    {
+        uint64_t length;
+        if (!read(length) || length > uint64_t(end - pos))
+            return false;
+        v.assign(pos, pos + length);
+        pos += length;
+        return true;
+    }
+};
+//---------------------------------------------------------------------------
 void Relation::storeRelation(const string& fileName)
 // Stores a relation into a binary file
 {
+    const uint32_t numColumns = columns.size();
+    RelationFileHeader header{};
+    header.fileMagic = RelationFileHeader::magic;
+    header.version = RelationFileHeader::currentVersion;
+    header.numColumns = numColumns;
+    header.size = size;
+
+    // Lay out the column segments behind the descriptors, compressed columns
+    // store their codes
+    vector<SegmentDescriptor> segments(numColumns);
+    uint64_t offset =
+        sizeof(RelationFileHeader) + numColumns * sizeof(SegmentDescriptor);
+    for (unsigned c = 0; c < numColumns; ++c)
+    {
+        auto& segment = segments[c];
+        segment.length = size * sizeof(uint64_t);
+        segment.encoding = SegmentEncoding::Raw;
+        if (!columns[c])
+        {
+            auto& column = compressed[c];
+            segment.length = sizeof(CompressedSegmentHeader) +
+                             column.dictionary.size() * sizeof(uint64_t) +
+                             column.codesLength();
+            segment.encoding =
+                column.encoding == CompressedColumn::Encoding::Dictionary
+                    ? SegmentEncoding::Dictionary
+                    : SegmentEncoding::FrameOfReference;
+        }
+        const uint64_t alignment =
+            segment.length >= hugePageSize ? hugePageSize : segmentAlignment;
+        segment.offset = alignUp(offset, alignment);
+        offset = segment.offset + segment.length;
+    }
+
+    // The footer holds the statistics and the zone maps of every column
+    vector<uint64_t> footer;
+    vector<uint64_t> buffer;
+    for (unsigned i = 0; i < numColumns; ++i)
+    {
+        auto c = values(i, buffer);
+        auto stats = ColumnStatistics::collect(c, size);
+        footer.insert(footer.end(), { stats.size, stats.min, stats.max,
+                                      stats.distinct, stats.sorted });
+        appendVector(footer, stats.bounds);
+        footer.push_back(stats.heavyHitters.size());
+        for (auto& heavyHitter : stats.heavyHitters)
+            footer.insert(footer.end(),
+                          { heavyHitter.first, heavyHitter.second });
+
+        auto zoneMap = ZoneMap::build(c, size);
+        appendVector(footer, zoneMap.mins);
+        appendVector(footer, zoneMap.maxs);
+    }
+    header.footerOffset = alignUp(offset, segmentAlignment);
+    header.footerLength = footer.size() * sizeof(uint64_t);
+    header.footerChecksum = checksum(footer.data(), header.footerLength);
+    header.checksum = headerChecksum(header, segments.data());
+
     ofstream outFile;
     outFile.open(fileName, ios::out | ios::binary);
-    outFile.write((char*)&size, sizeof(size));
-    auto numColumns = columns.size();
-    outFile.write((char*)&numColumns, sizeof(size_t));
-    for (auto c : columns)
+    outFile.write((char*)&header, sizeof(header));
+    outFile.write((char*)segments.data(),
+                  numColumns * sizeof(SegmentDescriptor));
+    // Seeking past the end leaves zero padding between the segments
+    for (unsigned i = 0; i < numColumns; ++i)
     {
-        outFile.write((char*)c, size * sizeof(uint64_t));
+        outFile.seekp(segments[i].offset);
+        if (columns[i])
+        {
+            outFile.write((char*)columns[i], segments[i].length);
+            continue;
+        }
+        auto& column = compressed[i];
+        CompressedSegmentHeader segmentHeader{ column.width, column.maxCode,
+                                               column.base,
+                                               column.dictionary.size() };
+        outFile.write((char*)&segmentHeader, sizeof(segmentHeader));
+        outFile.write((char*)column.dictionary.data(),
+                      column.dictionary.size() * sizeof(uint64_t));
+        outFile.write((const char*)column.codes(), column.codesLength());
     }
+    outFile.seekp(header.footerOffset);
+    outFile.write((char*)footer.data(), header.footerLength);
     outFile.close();
 }
 //---------------------------------------------------------------------------
+static bool readFooter(FooterReader footer, unsigned numColumns,
+                       uint64_t size, vector<ColumnStatistics>& statistics,
+                       vector<ZoneMap>& zoneMaps)
+// Read the statistics and the zone maps of all columns from a footer
+{
+    statistics.resize(numColumns);
+    zoneMaps.resize(numColumns);
+    for (unsigned c = 0; c < numColumns; ++c)
+    {
+        auto& stats = statistics[c];
+        uint64_t sorted, numHeavyHitters;
+        if (!footer.read(stats.size) || !footer.read(stats.min) ||
+            !footer.read(stats.max) || !footer.read(stats.distinct) ||
+            !footer.read(sorted) || !footer.read(stats.bounds) ||
+            !footer.read(numHeavyHitters) ||
+            numHeavyHitters > uint64_t(footer.end - footer.pos) / 2)
+            return false;
+        stats.sorted = sorted;
+        stats.heavyHitters.resize(numHeavyHitters);
+        for (auto& heavyHitter : stats.heavyHitters)
+        {
+            footer.read(heavyHitter.first);
+            footer.read(heavyHitter.second);
+        }
+        const uint64_t numZones = (size + ZoneMap::zoneSize - 1) /
+                                  ZoneMap::zoneSize;
+        if (!footer.read(zoneMaps[c].mins) || !footer.read(zoneMaps[c].maxs) ||
+            zoneMaps[c].mins.size() != numZones ||
+            zoneMaps[c].maxs.size() != numZones)
+            return false;
+    }
+    return footer.pos == footer.end;
+}
+//---------------------------------------------------------------------------
+const uint64_t* Relation::values(unsigned colId, vector<uint64_t>& buffer) const
+// The values of a column, compressed columns are decoded into the buffer
+{
+    if (columns[colId])
+        return columns[colId];
+    buffer.resize(size);
+    compressed[colId].decode(0, size, buffer.data());
+    return buffer.data();
+}
+//---------------------------------------------------------------------------
 void Relation::storeRelationCSV(const string& fileName)
 // Stores a relation into a file (csv), e.g., for loading/testing it with a DBMS
 {
@@ -29,9 +273,9 @@ void Relation::storeRelationCSV(const string& fileName)
     outFile.open(fileName + ".tbl", ios::out);
     for (uint64_t i = 0; i < size; ++i)
     {
-        for (auto& c : columns)
+        for (unsigned c = 0; c < columns.size(); ++c)
         {
-            outFile << c[i] << '|';
+            outFile << column(c)[i] << '|';
         }
         outFile << "\n";
     }
@@ -55,7 +299,212 @@ void Relation::dumpSQL(const string& fileName, unsigned relationId)
             << ".tbl' delimiter '|';\n";
 }
 //---------------------------------------------------------------------------
+void Relation::collectStatistics()
+// Collect the statistics of all columns
+{
+    statistics.clear();
+    vector<uint64_t> buffer;
+    for (unsigned c = 0; c < columns.size(); ++c)
+        statistics.push_back(
+            ColumnStatistics::collect(values(c, buffer), size));
+}
+//---------------------------------------------------------------------------
+void Relation::buildZoneMaps()
+// Build the zone maps of all columns
+{
+    zoneMaps.clear();
+    vector<uint64_t> buffer;
+    for (unsigned c = 0; c < columns.size(); ++c)
+        zoneMaps.push_back(ZoneMap::build(values(c, buffer), size));
+}
+//---------------------------------------------------------------------------
+static void releasePages(const void* begin, uint64_t length)
+// Drop the pages of a mapped range from memory (the whole pages inside it)
+{
+    const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    const uintptr_t first = alignUp(reinterpret_cast<uintptr_t>(begin),
+                                    pageSize);
+    const uintptr_t last =
+        (reinterpret_cast<uintptr_t>(begin) + length) & ~(pageSize - 1);
+    if (first < last)
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+}
+//---------------------------------------------------------------------------
+void Relation::compressColumns()
+// Compress all columns
+{
+    compressed.resize(columns.size());
+    for (unsigned c = 0; c < columns.size(); ++c)
+    {
+        // Columns that are mapped with their codes are compressed already
+        if (!columns[c])
+            continue;
+        compressed[c] =
+            CompressedColumn::compress(columns[c], size, statistics[c]);
+        if (compressed[c].encoding == CompressedColumn::Encoding::None)
+            continue;
+
+        // The codes replace the values, which leave the memory
+        if (ownsMemory)
+            delete[] columns[c];
+        else
+            releasePages(columns[c], size * sizeof(uint64_t));
+        columns[c] = nullptr;
+    }
+}
+//---------------------------------------------------------------------------
+uint64_t Relation::memoryUsage() const
+// The number of bytes of the columns
+{
+    uint64_t bytes = 0;
+    for (unsigned c = 0; c < columns.size(); ++c)
+        bytes += columns[c] ? size * sizeof(uint64_t)
+                            : compressed[c].memoryUsage();
+    return bytes;
+}
+//---------------------------------------------------------------------------
+void Relation::buildIndexes()
+// Build the sorted indexes of all columns
+{
+    indexes.clear();
+    indexes.resize(columns.size());
+    for (unsigned c = 0; c < columns.size(); ++c)
+    {
+        // The sidecar files are next to the relation file
+        const string indexFileName =
+            fileName + ".c" + to_string(c) + ".idx";
+        if (!fileName.empty() &&
+            SortedIndex::load(indexFileName, size, fileStamp, indexes[c]))
+            continue;
+
+        vector<uint64_t> buffer;
+        indexes[c] = SortedIndex::build(values(c, buffer), size);
+        // The index is rebuilt next time if it cannot be stored
+        if (!fileName.empty())
+            indexes[c].store(indexFileName, fileStamp);
+    }
+}
+//---------------------------------------------------------------------------
+static char* mapFile(int fd, uint64_t length)
+// Map a file read-only, files of at least a huge page are mapped at a huge
+// page boundary so that their aligned segments can use huge pages
+{
+    if (length < hugePageSize)
+        return static_cast<char*>(
+            mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0u));
+
+    // Reserve enough address space for an aligned mapping and release the
+    // rest afterwards
+    const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    const uint64_t reservedLength = length + hugePageSize;
+    auto reserved = static_cast<char*>(
+        mmap(nullptr, reservedLength, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0u));
+    if (reserved == MAP_FAILED)
+        return static_cast<char*>(MAP_FAILED);
+    auto aligned = reinterpret_cast<char*>(
+        alignUp(reinterpret_cast<uintptr_t>(reserved), hugePageSize));
+    auto addr = static_cast<char*>(mmap(aligned, length, PROT_READ,
+                                        MAP_PRIVATE | MAP_FIXED, fd, 0u));
+    if (addr == MAP_FAILED)
+    {
+        munmap(reserved, reservedLength);
+        return addr;
+    }
+    const uint64_t mappedEnd = alignUp(length, pageSize);
+    if (aligned > reserved)
+        munmap(reserved, aligned - reserved);
+    if (reserved + reservedLength > aligned + mappedEnd)
+        munmap(aligned + mappedEnd,
+               (reserved + reservedLength) - (aligned + mappedEnd));
+    return addr;
+}
+//---------------------------------------------------------------------------
+static uint64_t largestCode(const CompressedColumn& column)
+// The largest code of a compressed column (in parallel)
+{
+    BlockInfo bi(0, column.size);
+    vector<uint64_t> maxs(bi.blockCount);
+    parallel_for(bi, [&column, &maxs](unsigned rank, uint64_t begin,
+                                      uint64_t end) {
+        uint64_t largest = 0;
+        for (uint64_t i = begin; i < end; ++i)
+            largest = max(largest, column.code(i));
+        maxs[rank] = largest;
+    });
+    return *max_element(maxs.begin(), maxs.end());
+}
+//---------------------------------------------------------------------------
+static bool mapCodes(const SegmentDescriptor& segment, const char* addr,
+                     uint64_t size, CompressedColumn& column)
+// Use the codes of a compressed segment, false if the segment is invalid
+{
+    if (segment.length < sizeof(CompressedSegmentHeader) ||
+        (segment.encoding != SegmentEncoding::FrameOfReference &&
+         segment.encoding != SegmentEncoding::Dictionary))
+        return false;
+    auto header =
+        reinterpret_cast<const CompressedSegmentHeader*>(addr + segment.offset);
+    const uint64_t words =
+        (segment.length - sizeof(CompressedSegmentHeader)) / sizeof(uint64_t);
+    const bool dictionary = segment.encoding == SegmentEncoding::Dictionary;
+    // The bounds are checked before anything is multiplied
+    if ((header->width != 1 && header->width != 2 && header->width != 4) ||
+        header->maxCode >> (8 * header->width) ||
+        header->dictionarySize != (dictionary ? header->maxCode + 1 : 0) ||
+        header->dictionarySize > words ||
+        size > (words - header->dictionarySize) * sizeof(uint64_t) /
+                   header->width)
+        return false;
+
+    column.size = size;
+    column.encoding = dictionary ? CompressedColumn::Encoding::Dictionary
+                                 : CompressedColumn::Encoding::FrameOfReference;
+    column.width = header->width;
+    column.maxCode = header->maxCode;
+    column.base = header->base;
+    auto values = reinterpret_cast<const uint64_t*>(header + 1);
+    column.dictionary.assign(values, values + header->dictionarySize);
+    column.mapCodes(values + header->dictionarySize);
+    if (segment.length != sizeof(CompressedSegmentHeader) +
+                              header->dictionarySize * sizeof(uint64_t) +
+                              column.codesLength())
+        return false;
+
+    // Filters rely on ascending dictionaries, and a code beyond the largest
+    // one would be decoded outside of the dictionary
+    return adjacent_find(column.dictionary.begin(), column.dictionary.end(),
+                         greater_equal<uint64_t>()) ==
+               column.dictionary.end() &&
+           (size == 0 || largestCode(column) <= column.maxCode);
+}
+//---------------------------------------------------------------------------
+static void prefault(char* addr, uint64_t length)
+// Fault in all pages of a mapping in parallel, so that the queries do not
+// pay for the page faults
+{
+    madvise(addr, length, MADV_HUGEPAGE);
+    madvise(addr, length, MADV_WILLNEED);
+    madvise(addr, length, MADV_SEQUENTIAL);
+
+    const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    const uint64_t numPages = (length + pageSize - 1) / pageSize;
+    // Touch threads read one byte of every page of their block
+    BlockInfo bi(0, numPages, 256);
+    parallel_for(bi, [addr, pageSize](unsigned, uint64_t begin, uint64_t end) {
+        unsigned char sum = 0;
+        for (uint64_t page = begin; page < end; ++page)
+            sum += *static_cast<volatile char*>(addr + page * pageSize);
+        (void)sum;
+    });
+
+    // The queries access the columns in any order
+    madvise(addr, length, MADV_NORMAL);
+}
+//---------------------------------------------------------------------------
 void Relation::loadRelation(const char* fileName)
+// Loads a relation from disk, either in format version 2 or in the legacy
+// layout (size, number of columns and the packed columns)
 {
     int fd = open(fileName, O_RDONLY);
     if (fd == -1)
@@ -69,15 +518,19 @@ void Relation::loadRelation(const char* fileName)
     if (fstat(fd, &sb) == -1)
         cerr << "fstat\n";
 
-    auto length = sb.st_size;
+    uint64_t length = sb.st_size;
+    this->fileName = fileName;
+    fileStamp = uint64_t(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec;
 
-    char* addr = static_cast<char*>(
-        mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0u));
+    char* addr = mapFile(fd, length);
+    close(fd);
     if (addr == MAP_FAILED)
     {
         cerr << "cannot mmap " << fileName << " of length " << length << endl;
         throw;
     }
+    fileLength = length;
+    prefault(addr, length);
 
     if (length < 16)
     {
@@ -86,14 +539,81 @@ void Relation::loadRelation(const char* fileName)
         throw;
     }
 
-    this->size = *reinterpret_cast<uint64_t*>(addr);
-    addr += sizeof(size);
-    auto numColumns = *reinterpret_cast<size_t*>(addr);
-    addr += sizeof(size_t);
+    auto header = reinterpret_cast<const RelationFileHeader*>(addr);
+    if (length < sizeof(RelationFileHeader) ||
+        header->fileMagic != RelationFileHeader::magic)
+    {
+        // Legacy layout
+        this->size = *reinterpret_cast<uint64_t*>(addr);
+        addr += sizeof(size);
+        auto numColumns = *reinterpret_cast<size_t*>(addr);
+        addr += sizeof(size_t);
+        for (unsigned i = 0; i < numColumns; ++i)
+        {
+            this->columns.push_back(reinterpret_cast<uint64_t*>(addr));
+            addr += size * sizeof(uint64_t);
+        }
+        return;
+    }
+
+    auto segments = reinterpret_cast<const SegmentDescriptor*>(header + 1);
+    const uint64_t numColumns = header->numColumns;
+    if (header->version != RelationFileHeader::currentVersion ||
+        length < sizeof(RelationFileHeader) +
+                     numColumns * sizeof(SegmentDescriptor) ||
+        header->checksum != headerChecksum(*header, segments))
+    {
+        cerr << "relation file " << fileName
+             << " does not contain a valid header" << endl;
+        throw;
+    }
+
+    this->size = header->size;
+    vector<CompressedColumn> codes(numColumns);
+    bool anyCompressed = false;
     for (unsigned i = 0; i < numColumns; ++i)
     {
-        this->columns.push_back(reinterpret_cast<uint64_t*>(addr));
-        addr += size * sizeof(uint64_t);
+        auto& segment = segments[i];
+        bool valid = segment.offset % sizeof(uint64_t) == 0 &&
+                     segment.offset <= length &&
+                     segment.length <= length - segment.offset;
+        if (valid && segment.encoding == SegmentEncoding::Raw)
+            valid = size <= length / sizeof(uint64_t) &&
+                    segment.length == size * sizeof(uint64_t);
+        else if (valid)
+            valid = mapCodes(segment, addr, size, codes[i]);
+        if (!valid)
+        {
+            cerr << "relation file " << fileName << " has an invalid segment "
+                 << i << endl;
+            throw;
+        }
+        // Compressed columns only keep their codes
+        anyCompressed |= segment.encoding != SegmentEncoding::Raw;
+        this->columns.push_back(
+            segment.encoding == SegmentEncoding::Raw
+                ? reinterpret_cast<uint64_t*>(addr + segment.offset)
+                : nullptr);
+    }
+    if (anyCompressed)
+        compressed = move(codes);
+
+    // The column data is still valid if the footer is not, the statistics
+    // and zone maps are rebuilt then
+    const uint64_t footerEnd = header->footerOffset + header->footerLength;
+    if (header->footerOffset % sizeof(uint64_t) ||
+        header->footerLength % sizeof(uint64_t) ||
+        footerEnd < header->footerOffset || footerEnd > length)
+        return;
+    auto footer =
+        reinterpret_cast<const uint64_t*>(addr + header->footerOffset);
+    auto footerWords = header->footerLength / sizeof(uint64_t);
+    if (checksum(footer, header->footerLength) != header->footerChecksum ||
+        !readFooter({ footer, footer + footerWords }, numColumns, size,
+                    statistics, zoneMaps))
+    {
+        statistics.clear();
+        zoneMaps.clear();
     }
 }
 //---------------------------------------------------------------------------
@@ -101,6 +621,9 @@ Relation::Relation(const char* fileName) : ownsMemory(false)
 // Constructor that loads relation from disk
 {
     loadRelation(fileName);
+    // Relation files in format version 2 contain the zone maps
+    if (zoneMaps.size() != columns.size())
+        buildZoneMaps();
 }
 //---------------------------------------------------------------------------
 Relation::~Relation()
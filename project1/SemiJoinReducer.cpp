@@ -0,0 +1,181 @@
+#include "SemiJoinReducer.hpp"
+#include <algorithm>
+#include <map>
+#include "BloomFilter.hpp"
+#include "Materialize.hpp"
+#include "Operators.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// The join predicates between each pair of bindings (smaller binding first)
+using JoinEdges = map<pair<unsigned, unsigned>, vector<PredicateInfo>>;
+//---------------------------------------------------------------------------
+static JoinEdges collectEdges(const QueryInfo& query)
+// Group the join predicates by the pair of bindings they connect
+{
+    JoinEdges edges;
+    for (auto& p : query.predicates)
+    {
+        // Predicates within a relation do not connect it to others
+        if (p.left.binding == p.right.binding)
+            continue;
+        if (p.left.binding < p.right.binding)
+            edges[{ p.left.binding, p.right.binding }].push_back(p);
+        else
+            edges[{ p.right.binding, p.left.binding }].push_back(
+                PredicateInfo(p.right, p.left));
+    }
+    return edges;
+}
+//---------------------------------------------------------------------------
+bool SemiJoinReducer::isAcyclic(const QueryInfo& query)
+// Is the join graph of a query a tree (with at least three relations)?
+{
+    // With two relations the join is its own semi-join
+    const unsigned numBindings = query.relationIds.size();
+    if (numBindings < 3)
+        return false;
+
+    // A connected graph is a tree if it has one edge less than nodes
+    auto edges = collectEdges(query);
+    if (edges.size() != numBindings - 1)
+        return false;
+    vector<unsigned> component(numBindings);
+    for (unsigned b = 0; b < numBindings; ++b)
+        component[b] = b;
+    for (auto& [bindings, predicates] : edges)
+    {
+        const unsigned from = component[bindings.second];
+        const unsigned to = component[bindings.first];
+        for (auto& c : component)
+            if (c == from)
+                c = to;
+    }
+    return all_of(component.begin(), component.end(),
+                  [&component](unsigned c) { return c == component[0]; });
+}
+//---------------------------------------------------------------------------
+void SemiJoinReducer::reduce(const SelectInfo& targetColumn,
+                             const SelectInfo& sourceColumn)
+// Keep the rows of target whose key occurs among the keys of source
+{
+    auto& source = selections[sourceColumn.binding];
+    auto& target = selections[targetColumn.binding];
+    ColumnView sourceKeys = relations[sourceColumn.relId].column(
+        sourceColumn.colId, source.rowIds);
+    ColumnView targetKeys = relations[targetColumn.relId].column(
+        targetColumn.colId, target.rowIds);
+
+    BloomFilter bloomFilter(source.size);
+    parallel_for(BlockInfo(0, source.size), [sourceKeys, &bloomFilter](
+                                                unsigned, uint64_t begin,
+                                                uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i)
+            bloomFilter.insertConcurrent(sourceKeys[i]);
+    });
+
+    Materializer materializer(BlockInfo(0, target.size));
+    materializer.count([targetKeys, &bloomFilter](uint64_t begin,
+                                                  uint64_t end,
+                                                  uint64_t* counts) {
+        uint64_t localResultSize = 0;
+        for (uint64_t i = begin; i < end; ++i)
+            localResultSize += bloomFilter.contains(targetKeys[i]);
+        counts[0] = localResultSize;
+    });
+
+    // The row ids are 32 bit wide if the relation allows it
+    auto reduced = make_shared<RowIdColumn>(
+        RowIdColumn::fits(relations[targetColumn.relId].size));
+    reduced->resize(materializer.size());
+    auto write = [&](auto* rowIds) {
+        const RowIds targetRowIds = target.rowIds;
+        materializer.scatter([targetKeys, targetRowIds, &bloomFilter, rowIds](
+                                 uint64_t begin, uint64_t end,
+                                 const uint64_t* offsets) {
+            uint64_t offset = offsets[0];
+            for (uint64_t i = begin; i < end; ++i)
+                if (bloomFilter.contains(targetKeys[i]))
+                    rowIds[offset++] = targetRowIds[i];
+        });
+    };
+    if (reduced->isNarrow())
+        write(reduced->data<uint32_t>());
+    else
+        write(reduced->data<uint64_t>());
+
+    target = Selection{ reduced->view(), reduced->size() };
+    rowIds[targetColumn.binding] = move(reduced);
+}
+//---------------------------------------------------------------------------
+bool SemiJoinReducer::run()
+// Run
+{
+    if (!isAcyclic(query))
+        return false;
+    const unsigned numBindings = query.relationIds.size();
+
+    // The filtered relations are the input of the semi-joins
+    vector<unique_ptr<FilterScan>> scans(numBindings);
+    selections.resize(numBindings);
+    rowIds.assign(numBindings, nullptr);
+    for (unsigned b = 0; b < numBindings; ++b)
+    {
+        auto& relation = relations[query.relationIds[b]];
+        vector<FilterInfo> filters;
+        for (auto& f : query.filters)
+            if (f.filterColumn.binding == b)
+                filters.push_back(f);
+        if (filters.empty())
+        {
+            selections[b] = Selection{ RowIds(), relation.size };
+            continue;
+        }
+        scans[b] = make_unique<FilterScan>(relation, filters);
+        scans[b]->setCache(cache);
+        scans[b]->run();
+        selections[b] =
+            Selection{ scans[b]->getRowIds(b), scans[b]->resultSize };
+    }
+
+    // The join tree is rooted at binding 0, order holds the bindings in
+    // breadth-first order
+    auto edges = collectEdges(query);
+    vector<vector<PredicateInfo>> parentPredicates(numBindings);
+    vector<unsigned> order{ 0 };
+    vector<bool> visited(numBindings);
+    visited[0] = true;
+    for (unsigned i = 0; i < order.size(); ++i)
+    {
+        const unsigned parent = order[i];
+        for (auto& [bindings, predicates] : edges)
+        {
+            if (bindings.first != parent && bindings.second != parent)
+                continue;
+            const unsigned child = bindings.first == parent ? bindings.second
+                                                            : bindings.first;
+            if (visited[child])
+                continue;
+            visited[child] = true;
+            order.push_back(child);
+            // Oriented from the parent to the child
+            for (auto& p : predicates)
+                parentPredicates[child].push_back(
+                    p.left.binding == parent ? p
+                                             : PredicateInfo(p.right, p.left));
+        }
+    }
+
+    // Bottom-up: every parent keeps the rows that find a partner in all of
+    // its children, then top-down: every child keeps the rows that find a
+    // partner in its parent
+    for (unsigned i = order.size() - 1; i > 0; --i)
+        for (auto& p : parentPredicates[order[i]])
+            reduce(p.left, p.right);
+    for (unsigned i = 1; i < order.size(); ++i)
+        for (auto& p : parentPredicates[order[i]])
+            reduce(p.right, p.left);
+    return true;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+#include "SharedScan.hpp"
+#include <algorithm>
+#include "FilterKernels.hpp"
+#include "Materialize.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+void SharedScan::run()
+// Run
+{
+    if (RowIdColumn::fits(relation.size))
+        scanBlocks<uint32_t>();
+    else
+        scanBlocks<uint64_t>();
+}
+//---------------------------------------------------------------------------
+template <typename RowId>
+void SharedScan::scanBlocks()
+// Scan the relation
+{
+    const unsigned numSets = filterSets.size();
+
+    // Calls consume(set, selection, count) for each kernel block of
+    // [begin, end) and each filter set, the blocks are aligned to the zones
+    // of the zone maps
+    auto selectBlocks = [this, numSets](uint64_t begin, uint64_t end,
+                                        auto&& consume) {
+        RowId selection[FilterKernels::selectionSize];
+        for (uint64_t i = begin, blockEnd; i < end; i = blockEnd)
+        {
+            blockEnd = min<uint64_t>(end, (i / FilterKernels::blockSize + 1) *
+                                              FilterKernels::blockSize);
+            for (unsigned s = 0; s < numSets; ++s)
+            {
+                unsigned count = FilterKernels::select(
+                    relation, filterSets[s], i, blockEnd, selection);
+                consume(s, selection, count);
+            }
+        }
+    };
+
+    // Count the row ids of each block and filter set, then write them
+    // directly to their offsets
+    Materializer materializer(BlockInfo(0, relation.size), numSets);
+    materializer.count([&selectBlocks, numSets](uint64_t begin, uint64_t end,
+                                                uint64_t* counts) {
+        fill(counts, counts + numSets, 0);
+        selectBlocks(begin, end,
+                     [counts](unsigned s, const RowId*, unsigned count) {
+                         counts[s] += count;
+                     });
+    });
+
+    results.assign(numSets, RowIdColumn(sizeof(RowId) == sizeof(uint32_t)));
+    for (unsigned s = 0; s < numSets; ++s)
+        results[s].resize(materializer.size(s));
+
+    materializer.scatter([this, &selectBlocks, numSets](
+                             uint64_t begin, uint64_t end,
+                             const uint64_t* offsets) {
+        // The write position of each set moves on with every kernel block
+        vector<uint64_t> positions(offsets, offsets + numSets);
+        selectBlocks(begin, end, [this, &positions](unsigned s,
+                                                    const RowId* selection,
+                                                    unsigned count) {
+            copy(selection, selection + count,
+                 results[s].data<RowId>() + positions[s]);
+            positions[s] += count;
+        });
+    });
+}
+//---------------------------------------------------------------------------
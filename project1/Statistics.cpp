@@ -0,0 +1,235 @@
+#include "Statistics.hpp"
+#include <algorithm>
+#include <cmath>
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+static inline uint64_t mixHash(uint64_t x)
+// Finalizer of MurmurHash3, every input bit affects every output bit
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+//---------------------------------------------------------------------------
+void HyperLogLog::add(uint64_t value)
+// Add a value
+{
+    const uint64_t hash = mixHash(value);
+    const unsigned index = hash >> (64 - precision);
+    // The remaining bits with a sentinel, so the rank is at most 64-precision+1
+    const uint64_t rest = (hash << precision) | (1ull << (precision - 1));
+    const uint8_t rank = __builtin_clzll(rest) + 1;
+    registers[index] = std::max(registers[index], rank);
+}
+//---------------------------------------------------------------------------
+void HyperLogLog::merge(const HyperLogLog& other)
+// Merge another sketch into this one
+{
+    for (unsigned i = 0; i < numRegisters; ++i)
+        registers[i] = std::max(registers[i], other.registers[i]);
+}
+//---------------------------------------------------------------------------
+uint64_t HyperLogLog::estimate() const
+// Estimate the number of distinct values added so far
+{
+    const double m = numRegisters;
+    double sum = 0;
+    unsigned zeros = 0;
+    for (auto r : registers)
+    {
+        sum += ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+    // Linear counting for small cardinalities
+    if (estimate <= 2.5 * m && zeros)
+        estimate = m * log(m / zeros);
+    return llround(estimate);
+}
+//---------------------------------------------------------------------------
+ColumnStatistics ColumnStatistics::collect(const uint64_t* column,
+                                           uint64_t size)
+// Collect the statistics of a column
+{
+    ColumnStatistics stats;
+    stats.size = size;
+    if (size == 0)
+        return stats;
+
+    // Min, max and distinct values are collected per block and merged
+    BlockInfo bi(0, size);
+    vector<uint64_t> mins(bi.blockCount, ~0ull), maxs(bi.blockCount, 0);
+    vector<HyperLogLog> sketches(bi.blockCount);
+    vector<char> sorted(bi.blockCount);
+    parallel_for(bi, [column, &mins, &maxs, &sketches, &sorted](
+                         unsigned rank, uint64_t begin, uint64_t end) {
+        uint64_t localMin = ~0ull, localMax = 0;
+        bool localSorted = true;
+        auto& sketch = sketches[rank];
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            localMin = std::min(localMin, column[i]);
+            localMax = std::max(localMax, column[i]);
+            sketch.add(column[i]);
+            // Compare with the previous value (of the previous block too)
+            localSorted &= i == 0 || column[i - 1] <= column[i];
+        }
+        mins[rank] = localMin;
+        maxs[rank] = localMax;
+        sorted[rank] = localSorted;
+    });
+
+    HyperLogLog sketch;
+    for (unsigned rank = 0; rank < bi.blockCount; ++rank)
+    {
+        stats.min = std::min(stats.min, mins[rank]);
+        stats.max = std::max(stats.max, maxs[rank]);
+        stats.sorted &= sorted[rank] != 0;
+        sketch.merge(sketches[rank]);
+    }
+    const uint64_t domain = stats.max - stats.min + 1;
+    stats.distinct = std::clamp<uint64_t>(sketch.estimate(), 1, size);
+    if (domain != 0)
+        stats.distinct = std::min(stats.distinct, domain);
+
+    // Histogram and heavy hitters are derived from an evenly spaced sample
+    const uint64_t numSamples = std::min(size, sampleSize);
+    vector<uint64_t> sample(numSamples);
+    for (uint64_t i = 0; i < numSamples; ++i)
+        sample[i] = column[i * size / numSamples];
+    sort(sample.begin(), sample.end());
+
+    for (unsigned b = 0; b <= numBuckets; ++b)
+        stats.bounds.push_back(
+            sample[std::min(numSamples - 1, b * numSamples / numBuckets)]);
+    stats.bounds.front() = stats.min;
+    stats.bounds.back() = stats.max;
+
+    // A value is heavy if it would fill at least half a histogram bucket
+    const uint64_t heavyThreshold =
+        std::max<uint64_t>(numSamples / numBuckets / 2, 2);
+    for (uint64_t i = 0; i < numSamples;)
+    {
+        uint64_t j = i + 1;
+        while (j < numSamples && sample[j] == sample[i])
+            ++j;
+        if (j - i >= heavyThreshold)
+            stats.heavyHitters.emplace_back(sample[i],
+                                            (j - i) * size / numSamples);
+        i = j;
+    }
+    return stats;
+}
+//---------------------------------------------------------------------------
+double ColumnStatistics::estimateEqual(uint64_t constant) const
+// Estimated fraction of values equal to the constant
+{
+    if (size == 0 || constant < min || constant > max)
+        return 0;
+
+    // Heavy hitters are known, the remaining values share the rest uniformly
+    uint64_t heavyCount = 0;
+    for (auto& [value, frequency] : heavyHitters)
+    {
+        if (value == constant)
+            return double(frequency) / size;
+        heavyCount += frequency;
+    }
+    const double remaining =
+        std::max(0.0, 1 - double(heavyCount) / size);
+    const uint64_t remainingDistinct =
+        distinct > heavyHitters.size() ? distinct - heavyHitters.size() : 1;
+    return remaining / remainingDistinct;
+}
+//---------------------------------------------------------------------------
+double ColumnStatistics::estimateLess(uint64_t constant) const
+// Estimated fraction of values less than the constant
+{
+    if (size == 0 || constant <= min)
+        return 0;
+    if (constant > max)
+        return 1;
+
+    // Whole buckets below the constant plus a linear part of its bucket
+    auto upperBounds = bounds.begin() + 1;
+    auto bucket =
+        lower_bound(upperBounds, bounds.end(), constant) - upperBounds;
+    double fraction = double(bucket) / numBuckets;
+    const double low = bounds[bucket], high = bounds[bucket + 1];
+    if (high > low && constant > low)
+        fraction += (constant - low) / (high - low) / numBuckets;
+    return std::min(fraction, 1.0);
+}
+//---------------------------------------------------------------------------
+double ColumnStatistics::estimateGreater(uint64_t constant) const
+// Estimated fraction of values greater than the constant
+{
+    if (size == 0 || constant >= max)
+        return 0;
+    return std::max(
+        0.0, 1 - estimateLess(constant) - estimateEqual(constant));
+}
+//---------------------------------------------------------------------------
+ZoneMap ZoneMap::build(const uint64_t* column, uint64_t size)
+// Build the zone map of a column
+{
+    ZoneMap zoneMap;
+    const uint64_t numZones = (size + zoneSize - 1) / zoneSize;
+    zoneMap.mins.resize(numZones);
+    zoneMap.maxs.resize(numZones);
+
+    BlockInfo bi(0, numZones, 16);
+    parallel_for(bi, [column, size, &zoneMap](unsigned, uint64_t begin,
+                                              uint64_t end) {
+        for (uint64_t zone = begin; zone < end; ++zone)
+        {
+            const uint64_t zoneEnd = std::min(size, (zone + 1) * zoneSize);
+            uint64_t localMin = ~0ull, localMax = 0;
+            for (uint64_t i = zone * zoneSize; i < zoneEnd; ++i)
+            {
+                localMin = std::min(localMin, column[i]);
+                localMax = std::max(localMax, column[i]);
+            }
+            zoneMap.mins[zone] = localMin;
+            zoneMap.maxs[zone] = localMax;
+        }
+    });
+    return zoneMap;
+}
+//---------------------------------------------------------------------------
+ZoneMap::Match ZoneMap::matchEqual(uint64_t zone, uint64_t constant) const
+// Match the values of a zone equal to the constant
+{
+    if (constant < mins[zone] || constant > maxs[zone])
+        return Match::None;
+    if (mins[zone] == maxs[zone])
+        return Match::All;
+    return Match::Some;
+}
+//---------------------------------------------------------------------------
+ZoneMap::Match ZoneMap::matchLess(uint64_t zone, uint64_t constant) const
+// Match the values of a zone less than the constant
+{
+    if (mins[zone] >= constant)
+        return Match::None;
+    if (maxs[zone] < constant)
+        return Match::All;
+    return Match::Some;
+}
+//---------------------------------------------------------------------------
+ZoneMap::Match ZoneMap::matchGreater(uint64_t zone, uint64_t constant) const
+// Match the values of a zone greater than the constant
+{
+    if (maxs[zone] <= constant)
+        return Match::None;
+    if (mins[zone] > constant)
+        return Match::All;
+    return Match::Some;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Parser.hpp"
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+class BatchCache
+{
+    /// Intermediate results that only depend on base relations (filtered row
+    /// ids, hash tables) are shared read-only by the queries of a batch. They
+    /// are keyed by the canonical form of their subplan.
+
+    /// The cached results
+    std::unordered_map<std::string,
+                       std::shared_future<std::shared_ptr<const void>>>
+        entries;
+    /// Protects the entries
+    std::mutex mutex;
+
+ public:
+    /// The number of lookups that found a result
+    std::atomic<uint64_t> hits = 0;
+    /// The number of lookups that built a result
+    std::atomic<uint64_t> misses = 0;
+
+    /// Get the result of a subplan, build it if it is not cached yet
+    /// (concurrent lookups of the same subplan wait for the first one)
+    template <typename T, typename Build>
+    std::shared_ptr<const T> get(const std::string& key, Build&& build)
+    {
+        std::promise<std::shared_ptr<const void>> promise;
+        std::shared_future<std::shared_ptr<const void>> future;
+        bool cached;
+        {
+            std::scoped_lock lock(mutex);
+            auto it = entries.find(key);
+            cached = it != entries.end();
+            if (cached)
+            {
+                future = it->second;
+            }
+            else
+            {
+                future = promise.get_future().share();
+                entries.emplace(key, future);
+            }
+        }
+
+        if (cached)
+        {
+            ++hits;
+            // Help with parallel loops while the result is built
+            ThreadPool::Get().Wait(future, false);
+            return std::static_pointer_cast<const T>(future.get());
+        }
+
+        ++misses;
+        std::shared_ptr<const T> result = build();
+        promise.set_value(result);
+        return result;
+    }
+    /// Get the result of a subplan if it is cached and ready (nullptr if not)
+    template <typename T>
+    std::shared_ptr<const T> find(const std::string& key)
+    {
+        std::scoped_lock lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end() ||
+            it->second.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::ready)
+            return nullptr;
+        ++hits;
+        return std::static_pointer_cast<const T>(it->second.get());
+    }
+    /// Add the result of a subplan
+    template <typename T>
+    void put(const std::string& key, std::shared_ptr<const T> result)
+    {
+        std::promise<std::shared_ptr<const void>> promise;
+        promise.set_value(std::move(result));
+        std::scoped_lock lock(mutex);
+        entries[key] = promise.get_future().share();
+    }
+    /// Drop all results (at the end of a batch)
+    void clear();
+    /// The key of the qualifying row ids of the filters of a binding
+    static std::string scanKey(RelationId relId, unsigned binding,
+                               const std::vector<FilterInfo>& filters)
+    {
+        return "scan " + canonicalFilters(relId, binding, filters);
+    }
+
+    /// The canonical form of the filters of a binding on a relation
+    static std::string canonicalFilters(RelationId relId, unsigned binding,
+                                        const std::vector<FilterInfo>& filters);
+};
+//---------------------------------------------------------------------------
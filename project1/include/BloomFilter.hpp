@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+//---------------------------------------------------------------------------
+struct ColumnView;
+//---------------------------------------------------------------------------
+class BloomFilter
+{
+    /// A register-blocked Bloom filter: all bits of a key are set in a single
+    /// 64 bit word, so a lookup touches one cache line
+
+    /// The words
+    std::vector<uint64_t> words;
+    /// The shift that turns a hash into a word
+    unsigned shift;
+
+    /// Hash a key
+    static inline uint64_t hash(uint64_t key)
+    {
+        // Finalizer of MurmurHash3
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+    /// The bits of a key within its word (taken from the low bits of the hash,
+    /// the high bits select the word)
+    static inline uint64_t pattern(uint64_t hash)
+    {
+        return (1ull << (hash & 63)) | (1ull << ((hash >> 6) & 63)) |
+               (1ull << ((hash >> 12) & 63)) | (1ull << ((hash >> 18) & 63));
+    }
+
+ public:
+    /// The number of bits reserved for each key
+    static constexpr unsigned bitsPerKey = 16;
+
+    /// The constructor
+    explicit BloomFilter(uint64_t numKeys);
+
+    /// Insert a key (not thread-safe)
+    void insert(uint64_t key)
+    {
+        auto h = hash(key);
+        words[h >> shift] |= pattern(h);
+    }
+    /// Insert a key, concurrently with other inserts
+    void insertConcurrent(uint64_t key)
+    {
+        auto h = hash(key);
+        __atomic_fetch_or(&words[h >> shift], pattern(h), __ATOMIC_RELAXED);
+    }
+    /// Is the key possibly contained?
+    bool contains(uint64_t key) const
+    {
+        auto h = hash(key);
+        auto p = pattern(h);
+        return (words[h >> shift] & p) == p;
+    }
+    /// Keep the row ids of a selection vector whose key is possibly
+    /// contained, returns the new number of row ids
+    template <typename RowId>
+    unsigned filter(const ColumnView& keys, RowId* selection,
+                    unsigned count) const;
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Statistics.hpp"
+//---------------------------------------------------------------------------
+struct FilterInfo;
+//---------------------------------------------------------------------------
+class CompressedColumn
+{
+    /// A lightweight compressed column: every value is replaced by a code of
+    /// 1, 2 or 4 bytes. The codes preserve the order of the values, so
+    /// filters are evaluated on the codes without decompressing them, and
+    /// joins decode the values they gather one by one. The codes are either
+    /// owned or mapped from a relation file.
+
+ public:
+    /// How values are mapped to codes
+    enum class Encoding
+    {
+        /// Not compressed (no encoding gives narrower codes)
+        None,
+        /// The difference of the value and the smallest value
+        FrameOfReference,
+        /// The position of the value in the sorted distinct values
+        Dictionary
+    };
+    /// The largest number of distinct values a dictionary is built for
+    static constexpr uint64_t maxDictionarySize = 1u << 16;
+
+ private:
+    /// The owned codes (in whole words, so that they are aligned)
+    std::vector<uint64_t> storage;
+    /// The codes (owned or mapped)
+    const void* data = nullptr;
+
+ public:
+    /// The number of values
+    uint64_t size = 0;
+    /// The encoding
+    Encoding encoding = Encoding::None;
+    /// The size of a code (in bytes)
+    unsigned width = sizeof(uint64_t);
+    /// The largest code
+    uint64_t maxCode = 0;
+    /// The smallest value (frame of reference)
+    uint64_t base = 0;
+    /// The distinct values in ascending order (dictionary)
+    std::vector<uint64_t> dictionary;
+
+    /// Compress a column (in parallel) with the encoding that gives the
+    /// narrowest codes
+    static CompressedColumn compress(const uint64_t* column, uint64_t size,
+                                     const ColumnStatistics& stats);
+    /// Use codes that are mapped from a file (they are not owned)
+    void mapCodes(const void* codes)
+    {
+        storage.clear();
+        data = codes;
+    }
+
+    /// The codes
+    const void* codes() const
+    {
+        return data;
+    }
+    /// The code of the i-th value
+    uint64_t code(uint64_t i) const
+    {
+        switch (width)
+        {
+            case 1:
+                return static_cast<const uint8_t*>(data)[i];
+            case 2:
+                return static_cast<const uint16_t*>(data)[i];
+            default:
+                return static_cast<const uint32_t*>(data)[i];
+        }
+    }
+    /// Decompress the i-th value
+    uint64_t operator[](uint64_t i) const
+    {
+        return encoding == Encoding::Dictionary ? dictionary[code(i)]
+                                                : base + code(i);
+    }
+    /// Decompress count values from the i-th value on
+    void decode(uint64_t i, uint64_t count, uint64_t* values) const;
+    /// Decompress the values of count rows (32 or 64 bit row ids)
+    template <typename RowId>
+    void gather(const RowId* rowIds, uint64_t count, uint64_t* values) const;
+    /// The codes [low, high] of the values that pass a filter, false if no
+    /// value passes
+    bool translate(const FilterInfo& f, uint64_t& low, uint64_t& high) const;
+    /// The number of bytes of the codes (in whole words)
+    uint64_t codesLength() const
+    {
+        return (size * width + 7) / 8 * 8;
+    }
+    /// The number of bytes used by the codes and the dictionary
+    uint64_t memoryUsage() const;
+
+    /// The constructor
+    CompressedColumn() = default;
+    /// Delete copy constructor
+    CompressedColumn(const CompressedColumn& other) = delete;
+    /// Move constructor (the owned codes keep their address)
+    CompressedColumn(CompressedColumn&& other) noexcept = default;
+    /// Move assignment
+    CompressedColumn& operator=(CompressedColumn&& other) noexcept = default;
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Compression.hpp"
+#include "Parser.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+class FilterKernels
+{
+    /// Filters are evaluated on blocks of a column: every comparison produces
+    /// a bitmask, the bitmasks of all filters are and-ed, and the positions
+    /// of the set bits are compacted into a selection vector
+
+ public:
+    /// The instruction sets with kernels
+    enum class Isa
+    {
+        Scalar,
+        AVX2,
+        AVX512
+    };
+    /// The maximum number of values processed at once (one zone of the zone
+    /// maps)
+    static constexpr unsigned blockSize = ZoneMap::zoneSize;
+    /// The size a selection vector needs (the AVX2 compaction overshoots)
+    static constexpr unsigned selectionSize = blockSize + 8;
+
+    /// The best instruction set supported by the CPU
+    static Isa best();
+    /// Does a single value pass a filter?
+    static bool passes(const FilterInfo& f, uint64_t value)
+    {
+        switch (f.comparison)
+        {
+            case FilterInfo::Comparison::Less:
+                return value < f.constant;
+            case FilterInfo::Comparison::Greater:
+                return value > f.constant;
+            default:
+                return value == f.constant;
+        }
+    }
+    /// Compare count values with a constant, the result bits are written to
+    /// mask (combine = false) or and-ed into it (combine = true)
+    static void evaluate(Isa isa, const uint64_t* column, uint64_t count,
+                         FilterInfo::Comparison comparison, uint64_t constant,
+                         uint64_t* mask, bool combine);
+    /// Check whether the codes of count values of a compressed column (from
+    /// the begin-th on) are in [low, high], like evaluate
+    static void evaluateCodes(Isa isa, const CompressedColumn& column,
+                              uint64_t begin, uint64_t count, uint64_t low,
+                              uint64_t high, uint64_t* mask, bool combine);
+    /// Write firstId + i for every set bit i of mask to the selection vector,
+    /// returns the number of selected ids. The ids are 32 or 64 bit wide,
+    /// 32 bit ids are compacted twice as many at a time.
+    template <typename RowId>
+    static unsigned compact(Isa isa, const uint64_t* mask, uint64_t count,
+                            uint64_t firstId, RowId* selection);
+    /// Match the values of a zone against a filter
+    static ZoneMap::Match matchZone(const ZoneMap& zoneMap, uint64_t zone,
+                                    const FilterInfo& f);
+    /// Select the row ids in [begin, end) that pass all filters, blocks
+    /// inside a zone are skipped or accepted using the zone maps, and
+    /// compressed columns are filtered on their codes
+    template <typename RowId>
+    static unsigned select(Relation& relation,
+                           const std::vector<FilterInfo>& filters,
+                           uint64_t begin, uint64_t end, RowId* selection,
+                           Isa isa = best());
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+//---------------------------------------------------------------------------
+struct FilterInfo;
+//---------------------------------------------------------------------------
+class SortedIndex
+{
+    /// A secondary index of a column: the values in ascending order and the
+    /// row each value belongs to (rows with equal values in ascending order).
+    /// The entries are either owned or mapped from a sidecar file.
+
+    /// The number of entries
+    uint64_t count = 0;
+    /// The owned entries (the keys, then the row ids)
+    std::vector<uint64_t> storage;
+    /// The mapped sidecar file (nullptr if the entries are owned)
+    void* mapping = nullptr;
+    /// The length of the mapping
+    uint64_t mappingLength = 0;
+
+ public:
+    /// The values in ascending order
+    const uint64_t* keys = nullptr;
+    /// The row id of each value
+    const uint64_t* rowIds = nullptr;
+
+    /// Build the index of a column (in parallel)
+    static SortedIndex build(const uint64_t* column, uint64_t size);
+    /// Map the index from a sidecar file, fails if the file does not exist
+    /// or belongs to other data (a different size or stamp)
+    static bool load(const std::string& fileName, uint64_t size,
+                     uint64_t stamp, SortedIndex& index);
+    /// Store the index into a sidecar file, the stamp identifies the version
+    /// of the indexed data
+    bool store(const std::string& fileName, uint64_t stamp) const;
+
+    /// The positions [first, last) of the entries with the key
+    std::pair<uint64_t, uint64_t> equalRange(uint64_t key) const;
+    /// The positions [first, last) of the entries that pass a filter
+    std::pair<uint64_t, uint64_t> filterRange(const FilterInfo& f) const;
+    /// The number of entries
+    uint64_t size() const
+    {
+        return count;
+    }
+
+    /// The constructor
+    SortedIndex() = default;
+    /// Delete copy constructor
+    SortedIndex(const SortedIndex& other) = delete;
+    /// Move constructor
+    SortedIndex(SortedIndex&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+    /// Move assignment
+    SortedIndex& operator=(SortedIndex&& other) noexcept;
+    /// The destructor
+    ~SortedIndex();
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "RowIds.hpp"
+//---------------------------------------------------------------------------
+struct ColumnView;
+//---------------------------------------------------------------------------
+template <typename RowId = uint64_t>
+class JoinHashTable
+{
+    /// A hash table in CSR layout: the entries are stored sorted by bucket,
+    /// and the duplicates of a key are adjacent within their bucket, in the
+    /// order of their row ids. So a probe yields a range of entries, which is
+    /// read sequentially. The build is a stable scatter, first into ranges
+    /// of buckets, then within each range, so it needs no sort. Every
+    /// slot of the directory carries a 16 bit tag of the keys in its bucket,
+    /// most misses are rejected before an entry is touched.
+    ///
+    /// When the build keys are dense integers (their domain is not larger
+    /// than the directory of the hash table would be), the directory is
+    /// addressed by the key itself: every bucket holds exactly one key, and
+    /// a probe is a bounds check and two loads.
+    ///
+    /// The row ids (and the offsets of the entries) are of type RowId, so
+    /// builds of less than 2^32 rows use 32 bit row ids and move less data.
+
+ public:
+    /// An entry: a key and the row it belongs to (packed, so that a 32 bit
+    /// row id saves a quarter of the entry)
+#pragma pack(push, 4)
+    struct Entry
+    {
+        uint64_t key;
+        RowId rowId;
+    };
+#pragma pack(pop)
+    /// The entries that match a key
+    struct Range
+    {
+        RowId offset;
+        RowId count;
+    };
+    /// Bounds of the keys of a build that are known in advance (e.g. from
+    /// the statistics of the base column)
+    struct KeyDomain
+    {
+        uint64_t min, max;
+    };
+
+ private:
+    /// The number of bits of a directory slot that hold the offset
+    static constexpr unsigned offsetBits = 48;
+    static constexpr uint64_t offsetMask = (1ull << offsetBits) - 1;
+
+    /// The directory: the offset of the first entry of each bucket (low
+    /// bits) and the tag of the bucket (high bits). An additional slot holds
+    /// the number of entries.
+    std::vector<uint64_t> directory;
+    /// The entries, sorted by bucket and key
+    std::vector<Entry> entries;
+    /// The shift that turns a hash into a bucket
+    unsigned shift = 63;
+    /// Is the directory addressed by the key (minus the smallest key)?
+    bool dense = false;
+    /// The smallest key (dense tables only)
+    uint64_t minKey = 0;
+
+    /// The number of probes whose memory accesses are interleaved
+    static constexpr unsigned probeGroupSize = 16;
+    /// The size up to which a table is assumed to stay in the cache, its
+    /// probes are not prefetched
+    static constexpr uint64_t cacheResidentSize = 1u << 18;
+    /// The number of tuples a range of buckets should have to stay cache
+    /// resident while it is filled
+    static constexpr uint64_t partitionSize = 1u << 13;
+    /// The maximum number of bits of the bucket ranges
+    static constexpr unsigned maxPartitionBits = 12;
+    /// The number of entries up to which a bucket is grouped in place
+    static constexpr unsigned smallBucketSize = 16;
+
+    /// Hash a key
+    static inline uint64_t hash(uint64_t key)
+    {
+        // Multiplicative hashing, the high bits are well mixed
+        return key * 0x9E3779B97F4A7C15ull;
+    }
+    /// The tag bit of a hash (taken from the four bits below the bits that
+    /// select the bucket)
+    inline uint64_t tag(uint64_t hash) const
+    {
+        return 1ull << (offsetBits + ((hash >> (shift - 4)) & 15));
+    }
+    /// The number of buckets
+    uint64_t numBuckets() const
+    {
+        return directory.size() - 1;
+    }
+    /// The bucket of a key with the given hash (dense tables ignore the
+    /// hash, the bucket of a key outside of the domain is out of range)
+    uint64_t bucketOf(uint64_t key, uint64_t h) const
+    {
+        return dense ? key - minKey : h >> shift;
+    }
+    /// Choose the number of bits of the bucket ranges of a build
+    static unsigned choosePartitionBits(uint64_t size, unsigned domainBits);
+    /// Place the tuples of the buckets [firstBucket, endBucket) at offset,
+    /// tuples(i) is the i-th of the count tuples
+    template <typename Tuples>
+    void fillBuckets(const Tuples& tuples, uint64_t count,
+                     uint64_t firstBucket, uint64_t endBucket,
+                     uint64_t offset);
+    /// Find the entries of a key with the given hash
+    Range probe(uint64_t key, uint64_t h) const
+    {
+        const uint64_t bucket = bucketOf(key, h);
+        if (dense)
+        {
+            if (bucket >= numBuckets())
+                return Range{ 0, 0 };
+            const uint64_t begin = directory[bucket];
+            return Range{ RowId(begin), RowId(directory[bucket + 1] - begin) };
+        }
+
+        const uint64_t slot = directory[bucket];
+        if (!(slot & tag(h)))
+            return Range{ 0, 0 };
+
+        uint64_t begin = slot & offsetMask;
+        const uint64_t end = directory[bucket + 1] & offsetMask;
+        while (begin != end && entries[begin].key != key)
+            ++begin;
+        uint64_t count = 0;
+        while (begin + count != end && entries[begin + count].key == key)
+            ++count;
+        return Range{ RowId(begin), RowId(count) };
+    }
+
+ public:
+    /// Build the table on the first size keys of a column (replaces the
+    /// previous contents). The row id of the i-th key is rowIds[i], or i if
+    /// there are no rowIds. If the domain of the keys is known and dense, the
+    /// keys are not scanned for their minimum and maximum.
+    void build(const ColumnView& keys, uint64_t size,
+               RowIds rowIds = RowIds(), const KeyDomain* domain = nullptr);
+    /// Keep the first entry of each key, the row id of an entry becomes its
+    /// position (so the keys are numbered in the order of the entries)
+    void removeDuplicates();
+    /// Find the entries of a key
+    Range probe(uint64_t key) const
+    {
+        return probe(key, dense ? 0 : hash(key));
+    }
+    /// Find the entries of the keys [begin, end) of a column and store the
+    /// range of the i-th key in ranges[i]. The probes into a table that does
+    /// not fit into the cache are processed in groups whose memory accesses
+    /// are prefetched first, so their cache misses overlap.
+    void probe(const ColumnView& keys, uint64_t begin, uint64_t end,
+               Range* ranges) const;
+    /// Get an entry
+    const Entry& operator[](uint64_t offset) const
+    {
+        return entries[offset];
+    }
+    /// The number of entries
+    uint64_t size() const
+    {
+        return entries.size();
+    }
+    /// Is the directory addressed by the keys?
+    bool isDense() const
+    {
+        return dense;
+    }
+};
+//---------------------------------------------------------------------------
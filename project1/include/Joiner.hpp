@@ -1,25 +1,77 @@
 #pragma once
 #include <cstdint>
 #include <set>
+#include <string>
 #include <vector>
+#include "BatchCache.hpp"
 #include "Operators.hpp"
 #include "Parser.hpp"
 #include "Relation.hpp"
 //---------------------------------------------------------------------------
 class Joiner
 {
+    /// The row ids of each binding of a query (empty if not reduced)
+    using ReducedRowIds = std::vector<std::shared_ptr<const RowIdColumn>>;
+
     /// Add scan to query
     std::unique_ptr<Operator> addScan(std::set<unsigned>& usedRelations,
-                                      SelectInfo& info, QueryInfo& query);
+                                      SelectInfo& info, QueryInfo& query,
+                                      const ReducedRowIds& reduced);
+    /// Execute a query with operators that materialize their results
+    void runMaterialized(QueryInfo& query, std::vector<uint64_t>& checkSums,
+                         uint64_t& resultSize);
 
  public:
+    /// The execution engines
+    enum class Execution
+    {
+        /// Operators materialize their results (see Operators.hpp)
+        Materialized,
+        /// All operators are fused into one pipeline (see Pipeline.hpp)
+        Pipelined,
+        /// A pipeline that aggregates the relations at its end per join key
+        /// instead of enumerating their tuples
+        Factorized
+    };
+
     /// The relations that might be joined
     std::vector<Relation> relations;
+    /// The execution engine used for a query
+    Execution execution = Execution::Factorized;
+    /// The algorithm used for the joins of a query (materialized execution)
+    Join::Algorithm joinAlgorithm = Join::Algorithm::Adaptive;
+    /// Reduce the relations of acyclic queries by semi-joins before they are
+    /// joined (materialized execution)
+    bool semiJoinReduction = true;
+    /// Compress the columns in the preparation phase: the codes replace the
+    /// values, filters are evaluated on the codes and joins decode them
+    bool compression = true;
+    /// Share filtered row ids and hash tables between the queries of a batch
+    bool shareResults = true;
+    /// The results shared by the queries of the current batch
+    BatchCache batchCache;
+    /// Reuse the plans of repeated queries
+    bool cachePlans = true;
+    /// The plans of all queries so far, keyed by their normalized text (never
+    /// dropped, the statistics they depend on do not change)
+    BatchCache planCache;
     /// Add relation
     void addRelation(const char* fileName);
+    /// Add relations, they are loaded concurrently (preparation phase).
+    /// Returns the number of bytes loaded.
+    uint64_t addRelations(const std::vector<std::string>& fileNames);
+    /// Collect the statistics, compress the columns and build the indexes of
+    /// all relations (preparation phase). Returns the number of bytes of the
+    /// columns.
+    uint64_t prepare();
     /// Get relation
     Relation& getRelation(unsigned id);
     /// Joins a given set of relations
     std::string join(QueryInfo& i);
+    /// Plan a batch before its queries run: the filters of all queries on
+    /// the same relation are evaluated in one shared scan
+    void prepareBatch(std::vector<QueryInfo>& queries);
+    /// Drop the shared results of a batch (after all its queries are done)
+    void endBatch();
 };
 //---------------------------------------------------------------------------
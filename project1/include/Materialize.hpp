@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.hpp"
+//---------------------------------------------------------------------------
+class Materializer
+{
+    /// Two-pass materialization of a parallel loop without intermediate
+    /// buffers: every block counts its qualifying tuples first, the counts
+    /// are prefix-summed, and every block writes its tuples directly to its
+    /// offsets in the preallocated outputs.
+
+    /// The blocks of the loop
+    BlockInfo bi;
+    /// The number of outputs (e.g. one per filter set)
+    unsigned numOutputs;
+    /// The start offset of each block in each output (block major), followed
+    /// by the size of each output
+    std::vector<uint64_t> offsets;
+
+ public:
+    /// The constructor
+    Materializer(const BlockInfo& bi, unsigned numOutputs = 1)
+        : bi(bi),
+          numOutputs(numOutputs),
+          offsets((bi.blockCount + 1) * numOutputs){};
+
+    /// Count the tuples of every block, f(begin, end, counts) stores the
+    /// number of tuples of the block for output o in counts[o]
+    template <typename Func>
+    void count(Func&& f)
+    {
+        parallel_for(bi, [this, &f](unsigned rank, uint64_t begin,
+                                    uint64_t end) {
+            f(begin, end, offsets.data() + uint64_t(rank) * numOutputs);
+        });
+
+        // Exclusive prefix sum per output, the last row gets the sizes
+        for (unsigned o = 0; o < numOutputs; ++o)
+        {
+            uint64_t offset = 0;
+            for (unsigned b = 0; b <= bi.blockCount; ++b)
+            {
+                auto& entry = offsets[uint64_t(b) * numOutputs + o];
+                const uint64_t count = entry;
+                entry = offset;
+                offset += count;
+            }
+        }
+    }
+    /// The number of tuples of an output (after counting)
+    uint64_t size(unsigned output = 0) const
+    {
+        return offsets[uint64_t(bi.blockCount) * numOutputs + output];
+    }
+    /// Write the tuples of every block, f(begin, end, offsets) writes the
+    /// tuples of the block for output o from offsets[o] on. The blocks are
+    /// the same as in the counting pass, so they must produce the same tuples.
+    template <typename Func>
+    void scatter(Func&& f)
+    {
+        parallel_for(bi, [this, &f](unsigned rank, uint64_t begin,
+                                    uint64_t end) {
+            f(begin, end, offsets.data() + uint64_t(rank) * numOutputs);
+        });
+    }
+};
+//---------------------------------------------------------------------------
@@ -7,9 +7,13 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include "BloomFilter.hpp"
+#include "JoinHashTable.hpp"
 #include "Parser.hpp"
 #include "Relation.hpp"
 //---------------------------------------------------------------------------
+class BatchCache;
+//---------------------------------------------------------------------------
 namespace std
 {
 /// Simple hash function to enable use with unordered_map
@@ -25,15 +29,30 @@ struct hash<SelectInfo>
 //---------------------------------------------------------------------------
 class Operator
 {
-    /// Operators materialize their entire result
+    /// Operators materialize the row ids of the base relations, column values
+    /// are only gathered when they are needed
 
  protected:
     /// Mapping from select info to data
     std::unordered_map<SelectInfo, unsigned> select2ResultColId;
     /// The materialized results
     std::vector<uint64_t*> resultColumns;
-    /// The tmp results
-    std::vector<std::vector<uint64_t>> tmpResults;
+    /// The required columns (in the order of their result ids)
+    std::vector<SelectInfo> requiredColumns;
+    /// The tmp results (row ids, one column per binding)
+    std::vector<RowIdColumn> tmpResults;
+    /// Mapping from binding to its row ids in the tmp results
+    std::unordered_map<unsigned, unsigned> binding2RowIdColId;
+    /// The base relation of each binding
+    std::unordered_map<unsigned, Relation*> binding2Relation;
+    /// The gathered values of the required columns
+    std::vector<std::vector<uint64_t>> materializedResults;
+
+    /// Add a column to the results, its binding gets a row id column
+    void addRequiredColumn(SelectInfo info);
+    /// Can the row ids of all bindings be stored in 32 bits? (The tmp
+    /// results are 32 bit wide then)
+    bool narrowRowIds();
 
  public:
     /// Require a column and add it to results
@@ -46,8 +65,39 @@ class Operator
     }
     /// Run
     virtual void run() = 0;
-    /// Get  materialized results
+    /// Get the row ids of a binding (none if the result contains all rows of
+    /// the relation in order)
+    virtual RowIds getRowIds(unsigned binding);
+    /// Get the base relation of a binding
+    Relation* getRelation(unsigned binding)
+    {
+        assert(binding2Relation.find(binding) != binding2Relation.end());
+        return binding2Relation[binding];
+    }
+    /// Get a required column of the result
+    ColumnView getColumn(SelectInfo info)
+    {
+        return getRelation(info.binding)->column(info.colId,
+                                                 getRowIds(info.binding));
+    }
+    /// Get materialized results (gathers the values of the required columns)
     virtual std::vector<uint64_t*> getResults();
+    /// Would a Bloom filter on the given number of keys of a column drop
+    /// enough tuples of this operator?
+    virtual bool wantsBloomFilter(SelectInfo column, uint64_t numKeys)
+    {
+        return false;
+    }
+    /// Push a Bloom filter on a column into the operator (before it is run),
+    /// tuples whose key is not contained are dropped early
+    virtual void pushBloomFilter(SelectInfo column,
+                                 const BloomFilter* bloomFilter){};
+    /// Get a sorted index of a column whose row ids are the row ids of the
+    /// result (nullptr if there is none)
+    virtual const SortedIndex* getIndex(SelectInfo column)
+    {
+        return nullptr;
+    }
     /// The result size
     uint64_t resultSize = 0;
     /// The destructor
@@ -61,34 +111,76 @@ class Scan : public Operator
     Relation& relation;
     /// The name of the relation in the query
     unsigned relationBinding;
+    /// The Bloom filter pushed into the scan (nullptr if none)
+    const BloomFilter* bloomFilter = nullptr;
+    /// The column checked against the Bloom filter
+    unsigned bloomColumn;
+    /// The row ids of the qualifying tuples, if they are given or shared
+    std::shared_ptr<const RowIdColumn> sharedRowIds;
+
+    /// Select the rows that pass the filters and the Bloom filter
+    void selectRows(const std::vector<FilterInfo>& filters);
+    /// Select the rows block by block with the filter kernels, the row ids
+    /// are of type RowId
+    template <typename RowId>
+    void selectBlocks(const std::vector<FilterInfo>& filters);
+    /// Select the rows through the index of the most selective filter,
+    /// fails if no filter is selective enough
+    bool selectRowsByIndex(const std::vector<FilterInfo>& filters);
 
  public:
     /// The constructor
     Scan(Relation& r, unsigned relationBinding)
-        : relation(r), relationBinding(relationBinding){};
+        : relation(r), relationBinding(relationBinding)
+    {
+        binding2Relation[relationBinding] = &relation;
+    };
     /// Require a column and add it to results
     bool require(SelectInfo info) override;
     /// Run
     void run() override;
+    /// Get the row ids of a binding (all rows of the relation without a
+    /// Bloom filter or given row ids)
+    RowIds getRowIds(unsigned binding) override
+    {
+        if (sharedRowIds)
+            return sharedRowIds->view();
+        return bloomFilter ? Operator::getRowIds(binding) : RowIds();
+    }
+    /// Restrict the scan to the given rows (e.g. reduced by semi-joins)
+    void setRowIds(std::shared_ptr<const RowIdColumn> rowIds)
+    {
+        sharedRowIds = std::move(rowIds);
+    }
     /// Get  materialized results
     virtual std::vector<uint64_t*> getResults() override;
+    /// Would a Bloom filter on the given number of keys of a column drop
+    /// enough tuples of this operator?
+    bool wantsBloomFilter(SelectInfo column, uint64_t numKeys) override;
+    /// Push a Bloom filter on a column into the operator
+    void pushBloomFilter(SelectInfo column,
+                         const BloomFilter* bloomFilter) override;
+    /// Get the sorted index of a column (all rows of the relation without a
+    /// Bloom filter)
+    const SortedIndex* getIndex(SelectInfo column) override;
 };
 //---------------------------------------------------------------------------
 class FilterScan : public Scan
 {
     /// The filter info
     std::vector<FilterInfo> filters;
-    /// The input data
-    std::vector<uint64_t*> inputData;
-    /// Apply filter
-    bool applyFilter(uint64_t id, FilterInfo& f);
-    /// Copy tuple to result
-    void copy2Result(uint64_t id);
+    /// The cache shared with the other queries of the batch (nullptr if none)
+    BatchCache* cache = nullptr;
 
  public:
     /// The constructor
     FilterScan(Relation& r, std::vector<FilterInfo> filters)
-        : Scan(r, filters[0].filterColumn.binding), filters(filters){};
+        : Scan(r, filters[0].filterColumn.binding), filters(filters)
+    {
+        // The row ids of the qualifying tuples
+        binding2RowIdColId[relationBinding] = 0;
+        tmpResults.emplace_back();
+    };
     /// The constructor
     FilterScan(Relation& r, FilterInfo& filterInfo)
         : FilterScan(r, std::vector<FilterInfo>{ filterInfo }){};
@@ -96,43 +188,95 @@ class FilterScan : public Scan
     bool require(SelectInfo info) override;
     /// Run
     void run() override;
+    /// Get the row ids of a binding
+    RowIds getRowIds(unsigned binding) override
+    {
+        return sharedRowIds ? sharedRowIds->view()
+                            : Operator::getRowIds(binding);
+    }
+    /// Share the qualifying row ids with the other queries of a batch
+    void setCache(BatchCache* cache)
+    {
+        this->cache = cache;
+    }
     /// Get  materialized results
     virtual std::vector<uint64_t*> getResults() override
     {
         return Operator::getResults();
     }
+    /// The result is filtered, so the indexes of the relation do not apply
+    const SortedIndex* getIndex(SelectInfo column) override
+    {
+        return nullptr;
+    }
 };
 //---------------------------------------------------------------------------
 class Join : public Operator
 {
+ public:
+    /// The available join algorithms
+    enum class Algorithm
+    {
+        /// Single hash table build, parallel probe
+        Hash,
+        /// Radix partitioned build and probe
+        Radix,
+        /// Merge of inputs that are sorted by the key
+        SortMerge,
+        /// Lookups of the left keys in the sorted index of the right input
+        IndexNestedLoop,
+        /// Chosen from the inputs at run time
+        Adaptive
+    };
+
+ private:
     /// The input operators
     std::unique_ptr<Operator> left, right;
     /// The join predicate info
     PredicateInfo& pInfo;
-    /// Copy tuple to result
-    void copy2Result(uint64_t leftId, uint64_t rightId);
-    /// Create mapping for bindings
-    void createMappingForBindings();
 
-    using HT = std::unordered_multimap<uint64_t, uint64_t>;
-
-    /// The hash table for the join
-    HT hashTable;
     /// Columns that have to be materialized
     std::unordered_set<SelectInfo> requestedColumns;
-    /// Left/right columns that have been requested
-    std::vector<SelectInfo> requestedColumnsLeft, requestedColumnsRight;
+    /// Left/right bindings whose row ids have been requested
+    std::vector<unsigned> requestedBindingsLeft, requestedBindingsRight;
+
+    /// The row ids of left and right that have to be copied
+    std::vector<RowIds> copyLeftData, copyRightData;
+    /// The join algorithm
+    Algorithm algorithm;
+    /// The Bloom filter on the left keys that is pushed into the right input
+    std::unique_ptr<BloomFilter> bloomFilter;
+
+    /// Build a Bloom filter on the left keys and push it into the right input
+    void pushBloomFilter();
 
-    /// The entire input data of left and right
-    std::vector<uint64_t*> leftInputData, rightInputData;
-    /// The input data that has to be copied
-    std::vector<uint64_t*> copyLeftData, copyRightData;
+    /// Can the positions of the input tuples be stored in 32 bits?
+    bool narrowPositions() const;
+    /// Build a single hash table on the left input and probe it, the
+    /// positions of the input tuples are of type RowId
+    template <typename RowId>
+    void runHash(ColumnView leftKeyColumn, ColumnView rightKeyColumn);
+    /// Partition both inputs and join the partitions independently, the
+    /// positions of the input tuples are of type RowId
+    template <typename RowId>
+    void runRadix(ColumnView leftKeyColumn, ColumnView rightKeyColumn);
+    /// Merge the inputs, which are sorted by their keys
+    void runSortMerge(ColumnView leftKeyColumn, ColumnView rightKeyColumn);
+    /// Look up the left keys in the sorted index of the right input
+    void runIndexNestedLoop(ColumnView leftKeyColumn,
+                            const SortedIndex& index);
+    /// Choose the algorithm for the inputs (after they are run)
+    Algorithm chooseAlgorithm(ColumnView leftKeyColumn,
+                              ColumnView rightKeyColumn);
 
  public:
     /// The constructor
     Join(std::unique_ptr<Operator>&& left, std::unique_ptr<Operator>&& right,
-         PredicateInfo& pInfo)
-        : left(std::move(left)), right(std::move(right)), pInfo(pInfo){};
+         PredicateInfo& pInfo, Algorithm algorithm = Algorithm::Hash)
+        : left(std::move(left)),
+          right(std::move(right)),
+          pInfo(pInfo),
+          algorithm(algorithm){};
     /// Require a column and add it to results
     bool require(SelectInfo info) override;
     /// Run
@@ -145,15 +289,11 @@ class SelfJoin : public Operator
     std::unique_ptr<Operator> input;
     /// The join predicate info
     PredicateInfo& pInfo;
-    /// Copy tuple to result
-    void copy2Result(uint64_t id);
     /// The required IUs
-    std::set<SelectInfo> requiredIUs;
+    std::unordered_set<SelectInfo> requiredIUs;
 
-    /// The entire input data
-    std::vector<uint64_t*> inputData;
-    /// The input data that has to be copied
-    std::vector<uint64_t*> copyData;
+    /// The row ids of the input that have to be copied
+    std::vector<RowIds> copyData;
 
  public:
     /// The constructor
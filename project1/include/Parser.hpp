@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "Relation.hpp"
 //---------------------------------------------------------------------------
@@ -112,20 +113,20 @@ class QueryInfo
     void clear();
 
  private:
-    /// Parse a single predicate
-    void parsePredicate(std::string& rawPredicate);
+    /// Parse the predicate at a position and move behind it
+    void parsePredicate(std::string_view rawPredicates, size_t& pos);
     /// Resolve bindings of relation ids
     void resolveRelationIds();
 
  public:
     /// Parse relation ids <r1> <r2> ...
-    void parseRelationIds(std::string& rawRelations);
+    void parseRelationIds(std::string_view rawRelations);
     /// Parse predicates r1.a=r2.b&r1.b=r3.c...
-    void parsePredicates(std::string& rawPredicates);
+    void parsePredicates(std::string_view rawPredicates);
     /// Parse selections r1.a r1.b r3.c...
-    void parseSelections(std::string& rawSelections);
+    void parseSelections(std::string_view rawSelections);
     /// Parse selections [RELATIONS]|[PREDICATES]|[SELECTS]
-    void parseQuery(std::string& rawQuery);
+    void parseQuery(std::string_view rawQuery);
     /// Dump text format
     std::string dumpText();
     /// Dump SQL
@@ -135,6 +136,6 @@ class QueryInfo
     {
     }
     /// The constructor that parses a query
-    QueryInfo(std::string rawQuery);
+    QueryInfo(std::string_view rawQuery);
 };
 //---------------------------------------------------------------------------
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "BloomFilter.hpp"
+#include "JoinHashTable.hpp"
+#include "Parser.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+class BatchCache;
+//---------------------------------------------------------------------------
+class Pipeline
+{
+    /// All operators of a query are fused into one pipeline: the largest
+    /// relation is scanned in morsels, and every tuple is filtered, probed
+    /// into the hash tables of all other relations and summed up right away.
+    /// The pipeline only breaks to build the hash tables. The tuples flow
+    /// through it in batches, so the probes of a step are prefetched in
+    /// groups.
+    ///
+    /// When factorized, relations that are only needed for their join key
+    /// and their selected columns are aggregated per key while their hash
+    /// table is built (count and sums). The tuples are not enumerated: they
+    /// are probed last, and the checksums are computed from the counts.
+
+    /// A column of the current tuple
+    struct Column
+    {
+        /// The base column (all rows, compressed columns are decoded)
+        ColumnView data;
+        /// The binding whose row id is used
+        unsigned binding;
+    };
+    /// An equality check between two columns of the current tuple
+    struct Check
+    {
+        Column left, right;
+    };
+    /// A hash table on the join column of a filtered base relation
+    struct HashTable
+    {
+        /// The tuples by key, the row id of an entry is a row of the build
+        /// relation. Aggregated tables hold one entry per key instead, whose
+        /// position is the group of the key.
+        JoinHashTable<uint32_t> table;
+        /// The number of tuples of each group (aggregated tables only)
+        std::vector<uint64_t> counts;
+        /// The sums of the selected columns of each group (aggregated tables
+        /// only, one row of sums per group)
+        std::vector<uint64_t> sums;
+    };
+    /// A probe into the hash table of a relation
+    struct ProbeStep
+    {
+        /// The binding of the hash table
+        unsigned binding;
+        /// The build column
+        SelectInfo buildColumn;
+        /// The probe column
+        SelectInfo probeInfo;
+        /// The resolved probe column
+        Column probeColumn;
+        /// The hash table (shared with other queries of the batch)
+        std::shared_ptr<const HashTable> hashTable;
+        /// Checks of the predicates that are complete after this step
+        std::vector<Check> checks;
+        /// A Bloom filter on the build keys, applied by the scan when the
+        /// probe column belongs to the scanned relation (shared like the
+        /// hash table, nullptr if unused)
+        std::shared_ptr<const BloomFilter> bloomFilter;
+        /// Is the hash table aggregated per key?
+        bool aggregated = false;
+        /// The selections summed up in the aggregated hash table
+        std::vector<unsigned> sumSelections;
+        /// The bindings that are bound before this step
+        std::vector<unsigned> boundBindings;
+    };
+    /// The plan of a query: the scanned binding and the predicates that are
+    /// probed (positions in the predicates of the query), in pipeline order
+    struct Plan
+    {
+        unsigned sourceBinding;
+        std::vector<unsigned> probes;
+    };
+    /// A batch of tuples
+    struct Batch
+    {
+        /// The row ids of each binding (32 bit, like the row ids of the hash
+        /// tables)
+        std::vector<std::vector<uint32_t>> rowIds;
+        /// The number of tuples
+        unsigned count = 0;
+    };
+    /// The state of a worker, set up once for all of its morsels
+    struct LocalState
+    {
+        /// The input batch of each step up to the first aggregated one
+        /// (which is summed up)
+        std::vector<Batch> batches;
+        /// The entries that match the input batch of each step
+        std::vector<std::vector<JoinHashTable<uint32_t>::Range>> ranges;
+        /// The partial checksums
+        std::vector<uint64_t> sums;
+        /// The number of result tuples
+        uint64_t count = 0;
+    };
+
+    /// The relations that might be joined
+    std::vector<Relation>& relations;
+    /// The query
+    QueryInfo& query;
+    /// The binding that is scanned
+    unsigned sourceBinding;
+    /// The filters of the scanned relation
+    std::vector<FilterInfo> sourceFilters;
+    /// Checks of predicates within the scanned relation
+    std::vector<Check> sourceChecks;
+    /// The probes in pipeline order
+    std::vector<ProbeStep> steps;
+    /// The columns to sum up
+    std::vector<Column> selections;
+    /// Aggregate relations per join key where possible
+    bool factorize;
+    /// The results shared by the queries of a batch (nullptr if none)
+    BatchCache* cache;
+    /// The plans of earlier queries (nullptr if plans are not cached)
+    BatchCache* planCache;
+    /// The first aggregated step, all later steps are aggregated too
+    unsigned firstAggregated;
+    /// The selections whose values are enumerated (not aggregated)
+    std::vector<unsigned> enumeratedSelections;
+
+    /// Resolve a column of the query
+    Column resolve(const SelectInfo& info);
+    /// Choose the scanned relation and the order of the probes
+    Plan choosePlan();
+    /// Build the probe steps of the (cached or chosen) plan
+    void plan();
+    /// Move the steps whose relation can be aggregated to the end
+    void factorizeSteps();
+    /// Get the hash table of a probe step
+    void build(ProbeStep& step);
+    /// Build the hash table of a probe step
+    std::shared_ptr<HashTable> buildHashTable(const ProbeStep& step);
+    /// Aggregate the tuples of a hash table per key
+    void aggregate(const ProbeStep& step, HashTable& ht) const;
+    /// Evaluate checks on a tuple of a batch
+    static bool passes(const std::vector<Check>& checks, const Batch& batch,
+                       unsigned i);
+    /// Probe the input batch of a step and push the matches into the next
+    /// batch (or the checksum)
+    void consume(unsigned stepId, LocalState& state);
+    /// Add the input batch of the aggregated steps to the checksum
+    void sum(LocalState& state);
+    /// Push a morsel of the source through the pipeline
+    void scan(Relation& relation, const RowIdColumn* sourceRowIds,
+              uint64_t begin, uint64_t end, LocalState& state);
+
+ public:
+    /// The checksums of the selections
+    std::vector<uint64_t> checkSums;
+    /// The number of result tuples
+    uint64_t resultSize = 0;
+
+    /// The constructor
+    Pipeline(std::vector<Relation>& relations, QueryInfo& query,
+             bool factorize = true, BatchCache* cache = nullptr,
+             BatchCache* planCache = nullptr)
+        : relations(relations),
+          query(query),
+          factorize(factorize),
+          cache(cache),
+          planCache(planCache){};
+    /// Run
+    void run();
+    /// Can the pipeline run the query? (The hash tables store 32 bit row
+    /// ids, larger relations are joined by the materialized operators.)
+    static bool supports(const std::vector<Relation>& relations,
+                         const QueryInfo& query);
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "Parser.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+class Planner
+{
+    /// The relations that might be joined
+    std::vector<Relation>& relations;
+
+    /// Estimate the number of distinct values of a column after filtering
+    double estimateDistinct(const SelectInfo& info, double cardinality);
+
+ public:
+    /// The constructor
+    Planner(std::vector<Relation>& relations) : relations(relations){};
+    /// Estimate the selectivity of a filter from the column statistics
+    static double estimateSelectivity(const ColumnStatistics& stats,
+                                      const FilterInfo& f);
+    /// Estimate the selectivity of a filter
+    double estimateSelectivity(const FilterInfo& f);
+    /// Estimate the selectivity of a join predicate
+    double estimateSelectivity(const PredicateInfo& p,
+                               const std::vector<double>& cardinalities);
+    /// Estimate the cardinality of every binding after applying its filters
+    std::vector<double> estimateCardinalities(const QueryInfo& query);
+    /// Order the join predicates of a query (greedy, smallest intermediate
+    /// result first) and orient them so that the left side is the build side
+    void orderJoins(QueryInfo& query);
+};
+//---------------------------------------------------------------------------
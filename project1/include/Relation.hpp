@@ -1,30 +1,123 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
+#include "Compression.hpp"
+#include "Index.hpp"
+#include "RowIds.hpp"
+#include "Statistics.hpp"
 
 using RelationId = unsigned;
 //---------------------------------------------------------------------------
+/// A column of an intermediate result: the values of a base column at the
+/// row ids of the result
+struct ColumnView
+{
+    /// The base column (nullptr if only its codes are kept)
+    const uint64_t* base;
+    /// The row ids (none if the result contains all rows in order)
+    RowIds rowIds;
+    /// The codes of the base column (if it is compressed)
+    const CompressedColumn* codes = nullptr;
+
+    /// Get the value of a row of the base column
+    uint64_t value(uint64_t rowId) const
+    {
+        return base ? base[rowId] : (*codes)[rowId];
+    }
+    /// Get the value of the i-th tuple
+    uint64_t operator[](uint64_t i) const
+    {
+        return value(rowIds[i]);
+    }
+    /// Get the values of count tuples from the i-th on (the representation
+    /// of the column is checked once)
+    void gather(uint64_t i, uint64_t count, uint64_t* values) const
+    {
+        if (rowIds.narrow)
+            gather(rowIds.narrow + i, count, values);
+        else if (rowIds.wide)
+            gather(rowIds.wide + i, count, values);
+        else if (base)
+            std::copy(base + i, base + i + count, values);
+        else
+            codes->decode(i, count, values);
+    }
+    /// Get the values of count rows of the base column
+    template <typename RowId>
+    void gather(const RowId* rowIds, uint64_t count, uint64_t* values) const
+    {
+        if (base)
+            for (uint64_t j = 0; j < count; ++j)
+                values[j] = base[rowIds[j]];
+        else
+            codes->gather(rowIds, count, values);
+    }
+};
+//---------------------------------------------------------------------------
 class Relation
 {
  private:
     /// Owns memory (false if it was mmaped)
     bool ownsMemory;
-    /// Loads data from a file
+    /// The file the relation was loaded from (empty if not loaded)
+    std::string fileName;
+    /// The modification time of the file (in nanoseconds)
+    uint64_t fileStamp = 0;
+    /// The size of the file (in bytes)
+    uint64_t fileLength = 0;
+    /// Loads data from a file (format version 2 or the legacy layout) and
+    /// prefaults its pages
     void loadRelation(const char* fileName);
+    /// The values of a column, compressed columns are decoded into the buffer
+    const uint64_t* values(unsigned colId,
+                           std::vector<uint64_t>& buffer) const;
 
  public:
     /// The number of tuples
     uint64_t size;
-    /// The join column containing the keys
+    /// The uncompressed columns (nullptr if only the codes of a column are
+    /// kept)
     std::vector<uint64_t*> columns;
+    /// The statistics of each column (empty if not collected)
+    std::vector<ColumnStatistics> statistics;
+    /// The zone map of each column (empty if not built)
+    std::vector<ZoneMap> zoneMaps;
+    /// The sorted index of each column (empty if not built)
+    std::vector<SortedIndex> indexes;
+    /// The codes of each column (empty if no column is compressed, the
+    /// encoding is None for uncompressed columns)
+    std::vector<CompressedColumn> compressed;
 
-    /// Stores a relation into a file (binary)
+    /// Stores a relation into a file (binary, format version 2 with aligned
+    /// raw or compressed column segments and the statistics and zone maps in
+    /// a footer)
     void storeRelation(const std::string& fileName);
     /// Stores a relation into a file (csv)
     void storeRelationCSV(const std::string& fileName);
     /// Dump SQL: Create and load table (PostgreSQL)
     void dumpSQL(const std::string& fileName, unsigned relationId);
+    /// Collect the statistics of all columns
+    void collectStatistics();
+    /// Build the zone maps of all columns
+    void buildZoneMaps();
+    /// Compress all columns whose values fit into narrower codes (needs the
+    /// statistics), the uncompressed values of those columns are dropped
+    void compressColumns();
+    /// Build the sorted indexes of all columns, a loaded relation maps them
+    /// from sidecar files if they are up to date and stores them otherwise
+    void buildIndexes();
+    /// Get a column at the given row ids (none: all rows in order)
+    ColumnView column(unsigned colId, RowIds rowIds = RowIds()) const
+    {
+        return ColumnView{ columns[colId], rowIds,
+                           columns[colId] ? nullptr : &compressed[colId] };
+    }
+    /// The number of bytes of the columns (the codes of compressed columns)
+    uint64_t memoryUsage() const;
+    /// The size of the file the relation was loaded from (0 if not loaded)
+    uint64_t getFileLength() const { return fileLength; }
 
     /// Constructor without mmap
     Relation(uint64_t size, std::vector<uint64_t*>&& columns)
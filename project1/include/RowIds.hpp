@@ -0,0 +1,88 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+//---------------------------------------------------------------------------
+/// The row ids of a base relation in an intermediate result. They are 32 bit
+/// wide if the relations of the result have at most 2^32 tuples, which
+/// halves the memory traffic of the operators that write and read them.
+struct RowIds
+{
+    /// The 32 bit row ids (nullptr if they are 64 bit or absent)
+    const uint32_t* narrow = nullptr;
+    /// The 64 bit row ids (nullptr if they are 32 bit or absent)
+    const uint64_t* wide = nullptr;
+
+    /// No row ids: the result contains all rows in order
+    RowIds() = default;
+    RowIds(std::nullptr_t) {}
+    /// 32 bit row ids
+    RowIds(const uint32_t* narrow) : narrow(narrow) {}
+    /// 64 bit row ids
+    RowIds(const uint64_t* wide) : wide(wide) {}
+
+    /// Are there row ids?
+    explicit operator bool() const { return narrow || wide; }
+    /// Get the i-th row id
+    uint64_t operator[](uint64_t i) const
+    {
+        return narrow ? narrow[i] : wide ? wide[i] : i;
+    }
+};
+//---------------------------------------------------------------------------
+class RowIdColumn
+{
+    /// A column of row ids, whose width is chosen when it is created
+
+    /// The 32 bit row ids
+    std::vector<uint32_t> narrowRowIds;
+    /// The 64 bit row ids
+    std::vector<uint64_t> wideRowIds;
+    /// Are the row ids 32 bit wide?
+    bool narrow = false;
+
+ public:
+    /// Can the row ids of a relation with the given number of tuples be
+    /// stored in 32 bits?
+    static bool fits(uint64_t relationSize)
+    {
+        return relationSize <= UINT32_MAX;
+    }
+
+    /// The constructor
+    explicit RowIdColumn(bool narrow = false) : narrow(narrow) {}
+    /// Are the row ids 32 bit wide?
+    bool isNarrow() const { return narrow; }
+    /// The number of row ids
+    uint64_t size() const
+    {
+        return narrow ? narrowRowIds.size() : wideRowIds.size();
+    }
+    /// Change the number of row ids
+    void resize(uint64_t size)
+    {
+        if (narrow)
+            narrowRowIds.resize(size);
+        else
+            wideRowIds.resize(size);
+    }
+    /// Get the row ids (RowId has to match the width of the column)
+    template <typename RowId>
+    RowId* data()
+    {
+        assert(narrow == (sizeof(RowId) == sizeof(uint32_t)));
+        if constexpr (std::is_same_v<RowId, uint32_t>)
+            return narrowRowIds.data();
+        else
+            return wideRowIds.data();
+    }
+    /// Get a view on the row ids
+    RowIds view() const
+    {
+        return narrow ? RowIds(narrowRowIds.data())
+                      : RowIds(wideRowIds.data());
+    }
+};
+//---------------------------------------------------------------------------
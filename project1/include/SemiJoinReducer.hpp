@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Parser.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+class BatchCache;
+//---------------------------------------------------------------------------
+class SemiJoinReducer
+{
+    /// The relations of an acyclic query are reduced to the tuples that can
+    /// take part in its result before it is joined (Yannakakis): semi-joins
+    /// run along a join tree, first from the leaves to the root, then back.
+    /// The semi-joins probe Bloom filters, so a few dangling tuples remain.
+
+    /// The selected rows of a binding
+    struct Selection
+    {
+        /// The row ids (none if all rows of the relation are selected)
+        RowIds rowIds;
+        /// The number of rows
+        uint64_t size;
+    };
+
+    /// The relations that might be joined
+    std::vector<Relation>& relations;
+    /// The query
+    QueryInfo& query;
+    /// The results shared by the queries of a batch (nullptr if none)
+    BatchCache* cache;
+    /// The current selection of each binding
+    std::vector<Selection> selections;
+
+    /// Keep the rows of target whose key (targetColumn) occurs among the keys
+    /// (sourceColumn) of source
+    void reduce(const SelectInfo& targetColumn,
+                const SelectInfo& sourceColumn);
+
+ public:
+    /// The remaining row ids of each binding (after run)
+    std::vector<std::shared_ptr<const RowIdColumn>> rowIds;
+
+    /// The constructor
+    SemiJoinReducer(std::vector<Relation>& relations, QueryInfo& query,
+                    BatchCache* cache = nullptr)
+        : relations(relations), query(query), cache(cache){};
+    /// Is the join graph of a query a tree (with at least three relations)?
+    static bool isAcyclic(const QueryInfo& query);
+    /// Run, fails if the query is not acyclic
+    bool run();
+};
+//---------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Parser.hpp"
+#include "Relation.hpp"
+//---------------------------------------------------------------------------
+class SharedScan
+{
+    /// The filters of many queries on the same relation are evaluated in a
+    /// single pass: each block of the relation is loaded once and filtered
+    /// for every query while it is in the cache.
+
+    /// The scanned relation
+    Relation& relation;
+    /// The filters of each query (or group of queries with the same filters)
+    std::vector<std::vector<FilterInfo>> filterSets;
+
+    /// Scan the relation, the row ids are of type RowId
+    template <typename RowId>
+    void scanBlocks();
+
+ public:
+    /// The qualifying row ids of each filter set (32 bit wide if the
+    /// relation allows it)
+    std::vector<RowIdColumn> results;
+
+    /// The constructor
+    SharedScan(Relation& relation,
+               std::vector<std::vector<FilterInfo>> filterSets)
+        : relation(relation), filterSets(std::move(filterSets)){};
+    /// Run
+    void run();
+};
+//---------------------------------------------------------------------------
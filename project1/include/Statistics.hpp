@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+//---------------------------------------------------------------------------
+class HyperLogLog
+{
+ public:
+    /// The number of bits used to select a register
+    static constexpr unsigned precision = 12;
+    /// The number of registers
+    static constexpr unsigned numRegisters = 1u << precision;
+
+ private:
+    /// The registers (position of the first one bit)
+    std::vector<uint8_t> registers;
+
+ public:
+    /// The constructor
+    HyperLogLog() : registers(numRegisters){};
+    /// Add a value
+    void add(uint64_t value);
+    /// Merge another sketch into this one
+    void merge(const HyperLogLog& other);
+    /// Estimate the number of distinct values added so far
+    uint64_t estimate() const;
+};
+//---------------------------------------------------------------------------
+struct ColumnStatistics
+{
+    /// The number of buckets of the equi-depth histogram
+    static constexpr unsigned numBuckets = 64;
+    /// The number of values sampled for histogram and heavy hitters
+    static constexpr uint64_t sampleSize = 1u << 14;
+
+    /// The number of values
+    uint64_t size = 0;
+    /// The smallest value
+    uint64_t min = ~0ull;
+    /// The largest value
+    uint64_t max = 0;
+    /// The estimated number of distinct values
+    uint64_t distinct = 0;
+    /// Are the values in ascending order?
+    bool sorted = true;
+    /// Bounds of the equi-depth histogram, bucket i covers
+    /// [bounds[i], bounds[i + 1]] and holds size / numBuckets values
+    std::vector<uint64_t> bounds;
+    /// The most frequent values and their estimated frequency
+    std::vector<std::pair<uint64_t, uint64_t>> heavyHitters;
+
+    /// Collect the statistics of a column (in parallel)
+    static ColumnStatistics collect(const uint64_t* column, uint64_t size);
+
+    /// Estimated fraction of values equal to the constant
+    double estimateEqual(uint64_t constant) const;
+    /// Estimated fraction of values less than the constant
+    double estimateLess(uint64_t constant) const;
+    /// Estimated fraction of values greater than the constant
+    double estimateGreater(uint64_t constant) const;
+};
+//---------------------------------------------------------------------------
+struct ZoneMap
+{
+    /// The number of values summarized by a zone
+    static constexpr uint64_t zoneSize = 1024;
+
+    /// The smallest value of each zone
+    std::vector<uint64_t> mins;
+    /// The largest value of each zone
+    std::vector<uint64_t> maxs;
+
+    /// Build the zone map of a column (in parallel)
+    static ZoneMap build(const uint64_t* column, uint64_t size);
+
+    /// How many values of a zone satisfy a predicate
+    enum class Match
+    {
+        None,
+        Some,
+        All
+    };
+    /// Match the values of a zone equal to the constant
+    Match matchEqual(uint64_t zone, uint64_t constant) const;
+    /// Match the values of a zone less than the constant
+    Match matchLess(uint64_t zone, uint64_t constant) const;
+    /// Match the values of a zone greater than the constant
+    Match matchGreater(uint64_t zone, uint64_t constant) const;
+};
+//---------------------------------------------------------------------------
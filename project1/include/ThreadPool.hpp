@@ -1,11 +1,17 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <future>
+#include <limits>
+#include <mutex>
+#include <queue>
 #include <thread>
 #include <vector>
 
@@ -36,6 +42,19 @@ struct BlockInfo final
         }
     }
 
+    /// Split the work into blocks of (at most) a fixed size
+    static BlockInfo Morsels(std::uint64_t begin, std::uint64_t end,
+                             unsigned morselSize)
+    {
+        BlockInfo bi(begin, end, morselSize);
+        if (bi.blockSize > morselSize)
+        {
+            bi.blockCount = (bi.workSize + morselSize - 1) / morselSize;
+            bi.blockSize = morselSize;
+        }
+        return bi;
+    }
+
     const std::uint64_t begin;
     const std::uint64_t end;
     const unsigned workSize;
@@ -44,6 +63,90 @@ struct BlockInfo final
     unsigned blockSize;
 };
 
+// An intrusive task, the pool only moves pointers to tasks
+struct Task
+{
+    void (*run)(Task* task);
+    // Smaller values are more urgent, nested tasks inherit the priority
+    unsigned priority;
+};
+
+// Chase-Lev deque: the owner pushes and pops at the bottom, thieves steal at
+// the top (fixed capacity, push fails when it is full)
+class WorkStealingDeque final
+{
+ public:
+    static constexpr std::int64_t CAPACITY = 4096;
+
+    bool Push(Task* task)
+    {
+        const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        const std::int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+            return false;
+
+        buffer_[b & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Task* Pop()
+    {
+        const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+
+        Task* task = nullptr;
+        if (t <= b)
+        {
+            task = buffer_[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (t == b)
+            {
+                // The last task, race against thieves
+                if (!top_.compare_exchange_strong(t, t + 1,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed))
+                    task = nullptr;
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    Task* Steal()
+    {
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        Task* task =
+            buffer_[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+            return nullptr;
+        return task;
+    }
+
+    bool Empty() const
+    {
+        return bottom_.load(std::memory_order_relaxed) <=
+               top_.load(std::memory_order_relaxed);
+    }
+
+ private:
+    alignas(64) std::atomic<std::int64_t> top_{ 0 };
+    alignas(64) std::atomic<std::int64_t> bottom_{ 0 };
+    alignas(64) std::array<std::atomic<Task*>, CAPACITY> buffer_;
+};
+
 class ThreadPool final
 {
  public:
@@ -59,7 +162,8 @@ class ThreadPool final
     {
     }
 
-    ThreadPool(int workers) : NWORKER(workers)
+    ThreadPool(int workers)
+        : NWORKER(workers), deques_(workers), workerPriorities_(workers)
     {
         createWorkers();
     }
@@ -67,7 +171,8 @@ class ThreadPool final
     ~ThreadPool() noexcept
     {
         destroyWorkers();
-        instance_ = nullptr;
+        if (instance_ == this)
+            instance_ = nullptr;
     }
 
     void SetAsMainPool()
@@ -78,98 +183,356 @@ class ThreadPool final
     template <typename Func, typename... Args>
     TaskFuture Submit(Func&& f, Args&&... args)
     {
-        auto task = std::make_shared<std::packaged_task<void()>>(
+        return SubmitWithPriority(currentPriority_, std::forward<Func>(f),
+                                  std::forward<Args>(args)...);
+    }
+
+    // Submit a task with a priority (smaller values are more urgent), all
+    // parallel loops of the task run with the same priority
+    template <typename Func, typename... Args>
+    TaskFuture SubmitWithPriority(unsigned priority, Func&& f,
+                                  Args&&... args)
+    {
+        auto task = new SubmittedTask(
+            priority,
             std::bind(std::forward<Func>(f), std::forward<Args>(args)...));
+        auto future = task->packagedTask.get_future();
 
-        auto future = task->get_future();
+        pushShared(task);
+        notify(false);
 
+        return future;
+    }
+
+    // Wait for a future, the calling thread runs tasks meanwhile. Threads
+    // that wait inside a task only help with parallel loops: a new task
+    // could wait for a result that the waiting thread is producing.
+    template <typename Future>
+    void Wait(Future& future, bool runTasks = true)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) !=
+               std::future_status::ready)
         {
-            std::scoped_lock lock(mutex_);
-            tasks_.emplace_back([task]() { (*task)(); });
+            if (!runOneTask(!runTasks))
+                std::this_thread::yield();
         }
-
-        cv_.notify_one();
-
-        return future;
     }
 
+    // Run all blocks and return when they are done (fork/join), the calling
+    // thread runs blocks of this and other loops while it waits
     template <typename Func>
-    std::vector<TaskFuture> ParallelFor(const BlockInfo& bi, Func&& f)
+    void ParallelFor(const BlockInfo& bi, Func&& f)
     {
-        std::vector<TaskFuture> futures(bi.blockCount);
+        // The job lives on the stack, workers that take one of its
+        // references claim blocks until all are claimed
+        ForJob<Func> job(currentPriority_, bi, f);
+        const unsigned references =
+            std::min<unsigned>(bi.blockCount - 1, NWORKER);
+        job.references.store(references, std::memory_order_relaxed);
+        for (unsigned i = 0; i < references; ++i)
+            push(&job);
+        notify(true);
+
+        job.Work();
+        // References that have not been taken yet still point to the job
+        while (job.done.load(std::memory_order_acquire) < bi.blockCount ||
+               job.references.load(std::memory_order_acquire) > 0)
+        {
+            if (!runOneTask(true))
+                std::this_thread::yield();
+        }
+    }
+
+ private:
+    struct SubmittedTask final : Task
+    {
+        template <typename Func>
+        SubmittedTask(unsigned priority, Func&& f)
+            : Task{ &SubmittedTask::Run, priority },
+              packagedTask(std::forward<Func>(f))
+        {
+        }
 
-        mutex_.lock();
-        for (unsigned blockID = 0; blockID < bi.blockCount; ++blockID)
+        static void Run(Task* task)
         {
-            const unsigned blockBegin = bi.begin + blockID * bi.blockSize;
-            const unsigned blockEnd = (blockID == bi.blockCount - 1)
-                                          ? bi.end
-                                          : blockBegin + bi.blockSize;
+            auto self = static_cast<SubmittedTask*>(task);
+            self->packagedTask();
+            delete self;
+        }
 
-            auto task = std::make_shared<std::packaged_task<void()>>(std::bind(
-                std::forward<Func>(f), blockID, blockBegin, blockEnd));
+        std::packaged_task<void()> packagedTask;
+    };
 
-            futures[blockID] = task->get_future();
-            tasks_.emplace_back([task] { (*task)(); });
+    template <typename Func>
+    struct ForJob final : Task
+    {
+        ForJob(unsigned priority, const BlockInfo& bi, Func& f)
+            : Task{ &ForJob::Run, priority }, bi(bi), f(f)
+        {
         }
-        mutex_.unlock();
 
-        cv_.notify_all();
-        return futures;
-    }
+        static void Run(Task* task)
+        {
+            auto self = static_cast<ForJob*>(task);
+            self->Work();
+            // The job may be gone as soon as the reference is released
+            self->references.fetch_sub(1, std::memory_order_release);
+        }
+
+        void Work()
+        {
+            for (unsigned blockID;
+                 (blockID = next.fetch_add(1, std::memory_order_relaxed)) <
+                 bi.blockCount;)
+            {
+                const std::uint64_t blockBegin =
+                    bi.begin + std::uint64_t(blockID) * bi.blockSize;
+                const std::uint64_t blockEnd = (blockID == bi.blockCount - 1)
+                                                   ? bi.end
+                                                   : blockBegin + bi.blockSize;
+                f(blockID, blockBegin, blockEnd);
+                done.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        const BlockInfo& bi;
+        Func& f;
+        std::atomic<unsigned> next{ 0 };
+        std::atomic<unsigned> done{ 0 };
+        std::atomic<unsigned> references{ 0 };
+    };
 
- private:
     void createWorkers()
     {
         running_ = true;
 
         for (int i = 0; i < NWORKER; ++i)
         {
-            workers_.emplace_back(&ThreadPool::workerThread, this);
+            workers_.emplace_back(&ThreadPool::workerThread, this, i);
         }
     }
 
     void destroyWorkers()
     {
-        running_ = false;
-        cv_.notify_all();
+        {
+            std::scoped_lock lock(sleepMutex_);
+            running_ = false;
+        }
+        sleepCV_.notify_all();
 
         for (auto& worker : workers_)
             if (worker.joinable())
                 worker.join();
     }
 
-    void workerThread()
+    // Loops of workers go to their own deque, those of other threads to the
+    // shared queue
+    void push(Task* task)
     {
-        while (true)
+        if (currentPool_ == this && deques_[currentWorker_].Push(task))
+            return;
+
+        std::scoped_lock lock(sharedMutex_);
+        sharedLoops_.push_back(task);
+        sharedSize_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void pushShared(Task* task)
+    {
+        std::scoped_lock lock(sharedMutex_);
+        sharedTasks_.push(SharedEntry{ task, sharedSequence_++ });
+        sharedSize_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void notify(bool all)
+    {
+        // Pairs with the fence of a worker that goes to sleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) == 0)
+            return;
+
+        std::scoped_lock lock(sleepMutex_);
+        if (all)
+            sleepCV_.notify_all();
+        else
+            sleepCV_.notify_one();
+    }
+
+    Task* popShared(bool loopsOnly)
+    {
+        if (sharedSize_.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+
+        std::scoped_lock lock(sharedMutex_);
+        Task* task = nullptr;
+        if (!sharedLoops_.empty())
         {
-            std::packaged_task<void()> task;
+            task = sharedLoops_.front();
+            sharedLoops_.pop_front();
+        }
+        else if (!loopsOnly && !sharedTasks_.empty())
+        {
+            task = sharedTasks_.top().task;
+            sharedTasks_.pop();
+        }
+        else
+        {
+            return nullptr;
+        }
+        sharedSize_.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
 
+    // Own work first, then the parallel loops of running tasks (the most
+    // urgent first), and only then new tasks from the shared queue
+    Task* findTask(bool loopsOnly)
+    {
+        const bool isWorker = currentPool_ == this;
+        if (isWorker)
+            if (Task* task = deques_[currentWorker_].Pop())
+                return task;
+
+        int victim = -1;
+        unsigned best = std::numeric_limits<unsigned>::max();
+        for (int i = 0; i < NWORKER; ++i)
+        {
+            const unsigned priority =
+                workerPriorities_[i].load(std::memory_order_relaxed);
+            if (!deques_[i].Empty() && (victim < 0 || priority < best))
             {
-                std::unique_lock lock(mutex_);
-                cv_.wait(lock, [this] { return !running_ || !tasks_.empty(); });
+                victim = i;
+                best = priority;
+            }
+        }
+        if (victim >= 0 && !(isWorker && victim == int(currentWorker_)))
+            if (Task* task = deques_[victim].Steal())
+                return task;
+
+        if (Task* task = popShared(loopsOnly))
+            return task;
+
+        // Steal from the other workers, starting at a random victim
+        static thread_local std::uint64_t seed =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        for (int i = 0; i < NWORKER; ++i)
+        {
+            const int victim = (seed + i) % NWORKER;
+            if (isWorker && victim == int(currentWorker_))
+                continue;
+            if (Task* task = deques_[victim].Steal())
+                return task;
+        }
+        return nullptr;
+    }
+
+    bool runOneTask(bool loopsOnly = false)
+    {
+        Task* task = findTask(loopsOnly);
+        if (!task)
+            return false;
+
+        // Publish the priority, so thieves prefer urgent work
+        const unsigned previous = currentPriority_;
+        currentPriority_ = task->priority;
+        if (currentPool_ == this)
+            workerPriorities_[currentWorker_].store(
+                task->priority, std::memory_order_relaxed);
+        task->run(task);
+        currentPriority_ = previous;
+        if (currentPool_ == this)
+            workerPriorities_[currentWorker_].store(
+                previous, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool hasWork() const
+    {
+        if (sharedSize_.load(std::memory_order_relaxed) > 0)
+            return true;
+        for (auto& deque : deques_)
+            if (!deque.Empty())
+                return true;
+        return false;
+    }
 
-                if (!running_ && tasks_.empty())
-                    break;
+    void workerThread(unsigned index)
+    {
+        currentPool_ = this;
+        currentWorker_ = index;
 
-                task = std::move(tasks_.front());
-                tasks_.pop_front();
+        while (true)
+        {
+            if (runOneTask())
+                continue;
+
+            // Spin a little before going to sleep
+            bool found = false;
+            for (unsigned spin = 0; spin < 64 && !found; ++spin)
+            {
+                std::this_thread::yield();
+                found = hasWork();
             }
+            if (found)
+                continue;
 
-            task();
+            std::unique_lock lock(sleepMutex_);
+            if (!running_)
+            {
+                lock.unlock();
+                // Drain the remaining tasks before leaving
+                while (runOneTask())
+                    ;
+                break;
+            }
+            sleeping_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!hasWork())
+                sleepCV_.wait_for(lock, std::chrono::milliseconds(10));
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
         }
     }
 
  private:
     inline static ThreadPool* instance_{ nullptr };
+    // The pool and the index of the worker running on this thread
+    inline static thread_local ThreadPool* currentPool_{ nullptr };
+    inline static thread_local unsigned currentWorker_{ 0 };
+    // The priority of the task running on this thread
+    inline static thread_local unsigned currentPriority_{ 0 };
 
     std::vector<std::thread> workers_;
-    std::deque<std::packaged_task<void()>> tasks_;
+    std::vector<WorkStealingDeque> deques_;
+    // the priority of the task each worker is running
+    std::vector<std::atomic<unsigned>> workerPriorities_;
+
+    // tasks by priority and then in order, and loops of threads that are not
+    // workers
+    struct SharedEntry
+    {
+        Task* task;
+        std::uint64_t sequence;
+
+        bool operator<(const SharedEntry& other) const
+        {
+            if (task->priority != other.task->priority)
+                return task->priority > other.task->priority;
+            return sequence > other.sequence;
+        }
+    };
+    std::mutex sharedMutex_;
+    std::priority_queue<SharedEntry> sharedTasks_;
+    std::deque<Task*> sharedLoops_;
+    std::uint64_t sharedSequence_{ 0 };
+    std::atomic<std::size_t> sharedSize_{ 0 };
 
     // thread pool controllers
     bool running_{ false };
-    std::mutex mutex_;
-    std::condition_variable cv_;
+    std::atomic<unsigned> sleeping_{ 0 };
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCV_;
 };
 
 template <typename Func, typename... Args>
@@ -181,10 +544,7 @@ void parallel_for(const BlockInfo& bi, Func&& f, Args&&... args)
         return;
     }
 
-    auto futures = ThreadPool::Get().ParallelFor(bi, std::forward<Func>(f));
-
-    for (auto& future : futures)
-        future.wait();
+    ThreadPool::Get().ParallelFor(bi, f);
 }
 
 template <typename Func, typename... Args>
@@ -1,6 +1,7 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <memory>
-#include <mutex>
+#include <string>
 #include <vector>
 
 #include "Joiner.hpp"
@@ -12,54 +13,88 @@ using namespace std;
 //---------------------------------------------------------------------------
 int main(int argc, char* argv[])
 {
-    ThreadPool pool;
+    // One pool runs queries and their parallel loops, the main thread
+    // helps while it waits for the results
+    ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
     pool.SetAsMainPool();
 
-    // One thread is main thread
-    ThreadPool batchTP(pool.NWORKER - 1);
-
     Joiner joiner;
     // Read join relations
     string line;
+    vector<string> fileNames;
     while (getline(cin, line))
     {
         if (line == "Done")
             break;
-        joiner.addRelation(line.c_str());
+        fileNames.push_back(line);
     }
+    // Load and prefault all relations concurrently (not timed)
+    auto loadStart = chrono::steady_clock::now();
+    const uint64_t loadedBytes = joiner.addRelations(fileNames);
+    const double loadSeconds =
+        chrono::duration<double>(chrono::steady_clock::now() - loadStart)
+            .count();
+    cerr << "loaded " << fileNames.size() << " relations ("
+         << (loadedBytes >> 20) << " MiB) in " << loadSeconds * 1000
+         << " ms, " << loadedBytes / loadSeconds / (1 << 30) << " GiB/s"
+         << endl;
     // Preparation phase (not timed)
     // Build histograms, indexes,...
-    //
-    unsigned turn = 0;
-    std::vector<std::future<std::string>> queryOutputs;
-    queryOutputs.reserve(batchTP.NWORKER);
+    const uint64_t columnBytes = joiner.prepare();
+    cerr << "prepared the columns (" << (columnBytes >> 20) << " MiB)" << endl;
+
+    // The query infos and output slots of a batch are reused by the next
+    // batches, so their vectors keep their capacity
+    std::vector<QueryInfo> queries;
+    std::vector<QueryInfo> spareQueries;
+    std::vector<std::string> outputs;
+    std::vector<TaskFuture> queryDone;
     while (getline(cin, line))
     {
-        if (line == "F")
+        if (line != "F")
         {
-            for (unsigned i = 0; i < turn; ++i)
+            if (spareQueries.empty())
             {
-                std::cout << queryOutputs[i].get();
+                queries.emplace_back();
             }
-
-            turn = 0;
-            queryOutputs.clear();
-
-            continue;  // End of a batch
+            else
+            {
+                queries.push_back(move(spareQueries.back()));
+                spareQueries.pop_back();
+            }
+            queries.back().parseQuery(line);
+            continue;
         }
 
-        auto promise = std::make_shared<std::promise<std::string>>();
-        queryOutputs.emplace_back(promise->get_future());
+        // Batch planning: the filters of all queries are evaluated in
+        // shared scans before the queries run
+        joiner.prepareBatch(queries);
 
-        batchTP.Submit(
-            [promise, &joiner](std::string query) {
-                QueryInfo i;
-                i.parseQuery(query);
+        if (outputs.size() < queries.size())
+            outputs.resize(queries.size());
+        for (unsigned turn = 0; turn < queries.size(); ++turn)
+        {
+            // Earlier queries of a batch are printed first, so they are more
+            // urgent
+            queryDone.push_back(pool.SubmitWithPriority(
+                turn, [&joiner, &query = queries[turn],
+                       &output = outputs[turn]]() {
+                    output = joiner.join(query);
+                }));
+        }
 
-                promise->set_value(joiner.join(i));
-            }, std::move(line));
+        for (unsigned turn = 0; turn < queries.size(); ++turn)
+        {
+            pool.Wait(queryDone[turn]);
+            queryDone[turn].get();
+            std::cout << outputs[turn];
+        }
 
-        ++turn;
+        for (auto& query : queries)
+            spareQueries.push_back(move(query));
+        queries.clear();
+        queryDone.clear();
+        joiner.endBatch();
     }
 
     return 0;
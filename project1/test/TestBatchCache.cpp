@@ -0,0 +1,38 @@
+#include "BatchCache.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(BatchCache, CanonicalFilters)
+{
+    // Order and duplicates of the filters and the binding do not matter
+    QueryInfo first("3 0|0.0=1.0&0.1>5&0.2=7&1.1<3|0.0");
+    QueryInfo second("0 3|1.2=7&0.0=1.0&1.1>5&1.2=7|1.0");
+    auto key = BatchCache::canonicalFilters(3, 0, first.filters);
+    ASSERT_EQ(key, BatchCache::canonicalFilters(3, 1, second.filters));
+    ASSERT_NE(key, BatchCache::canonicalFilters(0, 1, first.filters));
+    ASSERT_NE(key, BatchCache::canonicalFilters(3, 0, second.filters));
+}
+//---------------------------------------------------------------------------
+TEST(BatchCache, BuildOnce)
+{
+    BatchCache cache;
+    unsigned builds = 0;
+    auto build = [&builds] {
+        ++builds;
+        return make_shared<const vector<uint64_t>>(3, 42);
+    };
+    auto first = cache.get<vector<uint64_t>>("a", build);
+    auto second = cache.get<vector<uint64_t>>("a", build);
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(builds, 1u);
+    ASSERT_EQ(cache.hits, 1u);
+
+    cache.get<vector<uint64_t>>("b", build);
+    cache.clear();
+    auto third = cache.get<vector<uint64_t>>("a", build);
+    ASSERT_NE(first, third);
+    ASSERT_EQ(builds, 3u);
+    ASSERT_EQ(*first, *third);
+}
+//---------------------------------------------------------------------------
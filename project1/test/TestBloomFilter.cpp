@@ -0,0 +1,56 @@
+#include "BloomFilter.hpp"
+#include "Relation.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(BloomFilter, Contains)
+{
+    for (uint64_t n : { 1ull, 100ull, 100000ull })
+    {
+        BloomFilter filter(n);
+        for (uint64_t i = 0; i < n; ++i)
+            filter.insert(i * 7);
+
+        // No false negatives
+        for (uint64_t i = 0; i < n; ++i)
+            ASSERT_TRUE(filter.contains(i * 7));
+
+        // Few false positives
+        uint64_t falsePositives = 0;
+        for (uint64_t i = 0; i < 100000; ++i)
+            falsePositives += filter.contains(i * 7 + 1);
+        ASSERT_LT(falsePositives, 2000u);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(BloomFilter, Filter)
+{
+    BloomFilter filter(10);
+    for (uint64_t i = 0; i < 10; ++i)
+        filter.insertConcurrent(i);
+
+    vector<uint64_t> keys(1000);
+    uint64_t selection[1000];
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        keys[i] = i * 13 % 1000;
+        selection[i] = i;
+    }
+    unsigned n =
+        filter.filter(ColumnView{ keys.data(), nullptr }, selection, 1000);
+
+    // The selection keeps its order and contains all keys < 10
+    unsigned matches = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (i > 0)
+        {
+            ASSERT_LT(selection[i - 1], selection[i]);
+        }
+        matches += keys[selection[i]] < 10;
+    }
+    ASSERT_EQ(matches, 10u);
+    ASSERT_LT(n, 50u);
+}
+//---------------------------------------------------------------------------
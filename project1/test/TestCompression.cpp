@@ -0,0 +1,122 @@
+#include <random>
+#include "Compression.hpp"
+#include "Parser.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+using Comparison = FilterInfo::Comparison;
+//---------------------------------------------------------------------------
+static CompressedColumn compress(const vector<uint64_t>& column)
+// Compress a column with its statistics
+{
+    auto stats = ColumnStatistics::collect(column.data(), column.size());
+    return CompressedColumn::compress(column.data(), column.size(), stats);
+}
+//---------------------------------------------------------------------------
+static void ASSERT_DECODES(const CompressedColumn& compressed,
+                           const vector<uint64_t>& column)
+{
+    vector<uint64_t> values(column.size());
+    compressed.decode(0, column.size(), values.data());
+    ASSERT_EQ(values, column);
+    for (uint64_t i = 0; i < column.size(); i += 97)
+        ASSERT_EQ(compressed[i], column[i]);
+    // Gather every third value backwards
+    vector<uint64_t> rowIds;
+    for (uint64_t i = column.size(); i >= 3; i -= 3)
+        rowIds.push_back(i - 3);
+    compressed.gather(rowIds.data(), rowIds.size(), values.data());
+    for (uint64_t i = 0; i < rowIds.size(); ++i)
+        ASSERT_EQ(values[i], column[rowIds[i]]);
+}
+//---------------------------------------------------------------------------
+TEST(CompressedColumn, FrameOfReference)
+{
+    mt19937_64 gen(42);
+    // The ranges of the values need codes of 1, 2 and 4 bytes, there are
+    // too many distinct values for narrower dictionary codes
+    for (auto [range, width] : { pair<uint64_t, unsigned>(200, 1),
+                                 { 60000, 2 },
+                                 { 1ull << 31, 4 } })
+    {
+        vector<uint64_t> column(100000);
+        for (auto& v : column)
+            v = (1ull << 40) + gen() % range;
+
+        auto compressed = compress(column);
+        ASSERT_EQ(compressed.encoding,
+                  CompressedColumn::Encoding::FrameOfReference);
+        ASSERT_EQ(compressed.width, width);
+        ASSERT_DECODES(compressed, column);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(CompressedColumn, Dictionary)
+{
+    // Few distinct values that are far apart
+    mt19937_64 gen(42);
+    vector<uint64_t> column(5000);
+    for (auto& v : column)
+        v = (gen() % 100) << 40;
+
+    auto compressed = compress(column);
+    ASSERT_EQ(compressed.encoding, CompressedColumn::Encoding::Dictionary);
+    ASSERT_EQ(compressed.width, 1u);
+    ASSERT_EQ(compressed.dictionary.size(), compressed.maxCode + 1);
+    ASSERT_DECODES(compressed, column);
+    ASSERT_LT(compressed.memoryUsage(), column.size() * sizeof(uint64_t) / 4);
+}
+//---------------------------------------------------------------------------
+TEST(CompressedColumn, Uncompressed)
+{
+    // Too many distinct values spread over the whole domain
+    mt19937_64 gen(42);
+    vector<uint64_t> column(100000);
+    for (auto& v : column)
+        v = gen();
+
+    ASSERT_EQ(compress(column).encoding, CompressedColumn::Encoding::None);
+    ASSERT_EQ(compress({}).encoding, CompressedColumn::Encoding::None);
+}
+//---------------------------------------------------------------------------
+TEST(CompressedColumn, Translate)
+{
+    mt19937_64 gen(42);
+    vector<uint64_t> forColumn(2000), dictionaryColumn(2000);
+    for (auto& v : forColumn)
+        v = 1000 + gen() % 500;
+    for (auto& v : dictionaryColumn)
+        v = 1000 + (gen() % 50) * 1000000;
+
+    for (auto& column : { forColumn, dictionaryColumn })
+    {
+        auto compressed = compress(column);
+        ASSERT_NE(compressed.encoding, CompressedColumn::Encoding::None);
+
+        // Constants below, inside and above the values
+        for (uint64_t constant :
+             { 0ull, 999ull, 1000ull, 1001ull, 1200ull, 1499ull, 1500ull,
+               2000000ull, 1000000ull * 49 + 1000, 1ull << 62 })
+        {
+            for (auto comparison :
+                 { Comparison::Equal, Comparison::Greater, Comparison::Less })
+            {
+                FilterInfo f(SelectInfo(0, 0, 0), constant, comparison);
+                uint64_t low, high;
+                bool any = compressed.translate(f, low, high);
+                for (uint64_t i = 0; i < column.size(); ++i)
+                {
+                    bool passes =
+                        comparison == Comparison::Equal
+                            ? column[i] == constant
+                            : comparison == Comparison::Greater
+                                  ? column[i] > constant
+                                  : column[i] < constant;
+                    uint64_t code = compressed.code(i);
+                    ASSERT_EQ(passes, any && low <= code && code <= high);
+                }
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,252 @@
+#include <random>
+#include "FilterKernels.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+using Comparison = FilterInfo::Comparison;
+//---------------------------------------------------------------------------
+static vector<FilterKernels::Isa> supportedIsas()
+// All instruction sets that can be run on this CPU
+{
+    vector<FilterKernels::Isa> isas{ FilterKernels::Isa::Scalar };
+    if (FilterKernels::best() != FilterKernels::Isa::Scalar)
+        isas.push_back(FilterKernels::Isa::AVX2);
+    if (FilterKernels::best() == FilterKernels::Isa::AVX512)
+        isas.push_back(FilterKernels::Isa::AVX512);
+    return isas;
+}
+//---------------------------------------------------------------------------
+static bool compare(uint64_t value, Comparison comparison, uint64_t constant)
+// Compare a single value
+{
+    switch (comparison)
+    {
+        case Comparison::Equal:
+            return value == constant;
+        case Comparison::Greater:
+            return value > constant;
+        case Comparison::Less:
+            return value < constant;
+    }
+    return false;
+}
+//---------------------------------------------------------------------------
+TEST(FilterKernels, Comparisons)
+{
+    // Values above 2^63 catch signed comparisons
+    vector<uint64_t> column(1000);
+    mt19937_64 gen(42);
+    for (auto& v : column)
+        v = (gen() % 16) << 60 | (gen() % 4);
+    const uint64_t constant = (8ull << 60) | 2;
+
+    for (auto isa : supportedIsas())
+    {
+        for (auto comparison :
+             { Comparison::Equal, Comparison::Greater, Comparison::Less })
+        {
+            // Odd sizes exercise the tails of the kernels
+            for (uint64_t count : { 1ull, 7ull, 64ull, 203ull, 1000ull })
+            {
+                uint64_t mask[16];
+                FilterKernels::evaluate(isa, column.data(), count, comparison,
+                                        constant, mask, false);
+                uint64_t selection[FilterKernels::selectionSize];
+                unsigned n =
+                    FilterKernels::compact(isa, mask, count, 100, selection);
+
+                unsigned expected = 0;
+                for (uint64_t i = 0; i < count; ++i)
+                {
+                    if (compare(column[i], comparison, constant))
+                    {
+                        ASSERT_LT(expected, n);
+                        ASSERT_EQ(selection[expected++], i + 100);
+                    }
+                }
+                ASSERT_EQ(n, expected);
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+TEST(FilterKernels, NarrowSelection)
+{
+    // 32 bit ids are compacted like 64 bit ones, up to the largest 32 bit id
+    mt19937_64 gen(42);
+    uint64_t mask[FilterKernels::blockSize / 64];
+    for (auto& word : mask)
+        word = gen() & gen();
+    mask[3] = 0;
+    mask[4] = ~0ull;
+    const uint64_t firstId = UINT32_MAX - FilterKernels::blockSize;
+
+    uint64_t wide[FilterKernels::selectionSize];
+    unsigned expected = FilterKernels::compact(
+        FilterKernels::Isa::Scalar, mask, FilterKernels::blockSize, firstId,
+        wide);
+    for (auto isa : supportedIsas())
+    {
+        uint32_t narrow[FilterKernels::selectionSize];
+        unsigned n = FilterKernels::compact(
+            isa, mask, FilterKernels::blockSize, firstId, narrow);
+        ASSERT_EQ(n, expected);
+        for (unsigned i = 0; i < n; ++i)
+            ASSERT_EQ(narrow[i], wide[i]);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(FilterKernels, MultipleFilters)
+{
+    const uint64_t size = 5000;
+    vector<uint64_t*> columns;
+    for (unsigned c = 0; c < 2; ++c)
+        columns.push_back(new uint64_t[size]);
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        columns[0][i] = i;
+        columns[1][i] = i % 10;
+    }
+    Relation r(size, move(columns));
+
+    vector<FilterInfo> filters;
+    filters.emplace_back(SelectInfo(0, 0, 0), 1000, Comparison::Greater);
+    filters.emplace_back(SelectInfo(0, 0, 0), 4000, Comparison::Less);
+    filters.emplace_back(SelectInfo(0, 0, 1), 3, Comparison::Equal);
+
+    for (auto isa : supportedIsas())
+    {
+        uint64_t selection[FilterKernels::selectionSize];
+        vector<uint64_t> rowIds;
+        for (uint64_t i = 0; i < size; i += FilterKernels::blockSize)
+        {
+            uint64_t end = min<uint64_t>(size, i + FilterKernels::blockSize);
+            unsigned n =
+                FilterKernels::select(r, filters, i, end, selection, isa);
+            rowIds.insert(rowIds.end(), selection, selection + n);
+        }
+        ASSERT_EQ(rowIds.size(), 300u);
+        for (auto rowId : rowIds)
+        {
+            ASSERT_GT(rowId, 1000u);
+            ASSERT_LT(rowId, 4000u);
+            ASSERT_EQ(rowId % 10, 3u);
+        }
+
+        // Without filters every row is selected
+        unsigned n = FilterKernels::select(r, {}, 10, 1010, selection, isa);
+        ASSERT_EQ(n, 1000u);
+        ASSERT_EQ(selection[999], 1009u);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(FilterKernels, ZoneMaps)
+{
+    // Sorted values make most zones match none or all rows
+    const uint64_t size = 10000;
+    vector<uint64_t*> columns{ new uint64_t[size], new uint64_t[size] };
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        columns[0][i] = i / 100;
+        columns[1][i] = 7;
+    }
+    Relation r(size, move(columns));
+
+    vector<FilterInfo> filters;
+    filters.emplace_back(SelectInfo(0, 0, 0), 15, Comparison::Greater);
+    filters.emplace_back(SelectInfo(0, 0, 0), 42, Comparison::Less);
+    filters.emplace_back(SelectInfo(0, 0, 1), 7, Comparison::Equal);
+
+    uint64_t selection[FilterKernels::selectionSize];
+    for (bool zoneMaps : { false, true })
+    {
+        if (zoneMaps)
+            r.buildZoneMaps();
+        vector<uint64_t> rowIds;
+        // Unaligned blocks cannot use the zone maps
+        for (uint64_t i = 0; i < size; i += 1000)
+        {
+            unsigned n = FilterKernels::select(r, filters, i, i + 1000,
+                                               selection);
+            rowIds.insert(rowIds.end(), selection, selection + n);
+        }
+        ASSERT_EQ(rowIds.size(), 2600u);
+        ASSERT_EQ(rowIds.front(), 1600u);
+        ASSERT_EQ(rowIds.back(), 4199u);
+
+        rowIds.clear();
+        for (uint64_t i = 0; i < size; i += FilterKernels::blockSize)
+        {
+            uint64_t end = min<uint64_t>(size, i + FilterKernels::blockSize);
+            unsigned n = FilterKernels::select(r, filters, i, end, selection);
+            rowIds.insert(rowIds.end(), selection, selection + n);
+        }
+        ASSERT_EQ(rowIds.size(), 2600u);
+        for (unsigned j = 0; j < rowIds.size(); ++j)
+            ASSERT_EQ(rowIds[j], 1600u + j);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(FilterKernels, CompressedColumns)
+{
+    // Codes of 1, 2 and 4 bytes (frame of reference) and a dictionary, the
+    // 4 byte codes need more distinct values than a dictionary takes
+    const uint64_t size = 100000;
+    vector<uint64_t*> columns;
+    for (unsigned c = 0; c < 4; ++c)
+        columns.push_back(new uint64_t[size]);
+    mt19937_64 gen(42);
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        columns[0][i] = 100 + gen() % 200;
+        columns[1][i] = 100 + gen() % 50000;
+        columns[2][i] = 100 + gen() % (1ull << 30);
+        columns[3][i] = (gen() % 20) << 50;
+    }
+    Relation r(size, move(columns));
+    r.collectStatistics();
+
+    // The rows selected by every filter and instruction set, without and
+    // with compression
+    vector<vector<uint64_t>> rowIds[2];
+    for (unsigned compressed = 0; compressed < 2; ++compressed)
+    {
+        if (compressed)
+            r.compressColumns();
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            const uint64_t sample = r.column(c)[size / 2];
+            for (auto comparison :
+                 { Comparison::Equal, Comparison::Greater, Comparison::Less })
+            {
+                vector<FilterInfo> filters{ FilterInfo(
+                    SelectInfo(0, 0, c), sample, comparison) };
+                for (auto isa : supportedIsas())
+                {
+                    uint64_t selection[FilterKernels::selectionSize];
+                    rowIds[compressed].emplace_back();
+                    // Odd block bounds exercise the tails of the kernels
+                    for (uint64_t i = 3; i < size; i += 1000)
+                    {
+                        unsigned n = FilterKernels::select(
+                            r, filters, i, min(size, i + 1000), selection,
+                            isa);
+                        rowIds[compressed].back().insert(
+                            rowIds[compressed].back().end(), selection,
+                            selection + n);
+                    }
+                    ASSERT_FALSE(rowIds[compressed].back().empty());
+                }
+            }
+        }
+    }
+    ASSERT_EQ(rowIds[0], rowIds[1]);
+    // The codes replace the values
+    for (unsigned c = 0; c < 4; ++c)
+        ASSERT_EQ(r.columns[c], nullptr);
+    for (unsigned c = 0; c < 3; ++c)
+        ASSERT_EQ(r.compressed[c].width, 1u << c);
+    ASSERT_EQ(r.compressed[3].encoding,
+              CompressedColumn::Encoding::Dictionary);
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include "Index.hpp"
+#include "Parser.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(SortedIndex, Build)
+{
+    // Descending keys with 5 duplicates each
+    const uint64_t size = 10000;
+    vector<uint64_t> column(size);
+    for (uint64_t i = 0; i < size; ++i)
+        column[i] = (size - 1 - i) / 5;
+
+    auto index = SortedIndex::build(column.data(), size);
+    ASSERT_EQ(index.size(), size);
+    for (uint64_t i = 1; i < size; ++i)
+    {
+        ASSERT_LE(index.keys[i - 1], index.keys[i]);
+        ASSERT_EQ(column[index.rowIds[i]], index.keys[i]);
+        // Equal keys are ordered by row id
+        if (index.keys[i - 1] == index.keys[i])
+        {
+            ASSERT_LT(index.rowIds[i - 1], index.rowIds[i]);
+        }
+    }
+
+    auto range = index.equalRange(7);
+    ASSERT_EQ(range.second - range.first, 5u);
+    ASSERT_EQ(index.rowIds[range.first], size - 40);
+    range = index.equalRange(size);
+    ASSERT_EQ(range.first, range.second);
+}
+//---------------------------------------------------------------------------
+TEST(SortedIndex, FilterRange)
+{
+    vector<uint64_t> column{ 5, 3, 9, 3, 7 };
+    auto index = SortedIndex::build(column.data(), column.size());
+
+    auto range = index.filterRange(
+        FilterInfo(SelectInfo(0, 0, 0), 5, FilterInfo::Less));
+    ASSERT_EQ(range, make_pair(0ul, 2ul));
+    range = index.filterRange(
+        FilterInfo(SelectInfo(0, 0, 0), 5, FilterInfo::Greater));
+    ASSERT_EQ(range, make_pair(3ul, 5ul));
+    range = index.filterRange(
+        FilterInfo(SelectInfo(0, 0, 0), 3, FilterInfo::Equal));
+    ASSERT_EQ(range, make_pair(0ul, 2ul));
+}
+//---------------------------------------------------------------------------
+TEST(SortedIndex, StoreLoad)
+{
+    const uint64_t size = 3000;
+    vector<uint64_t> column(size);
+    for (uint64_t i = 0; i < size; ++i)
+        column[i] = i * 7 % 1000;
+    auto index = SortedIndex::build(column.data(), size);
+    ASSERT_TRUE(index.store("test.c0.idx", 42));
+
+    SortedIndex loaded;
+    ASSERT_TRUE(SortedIndex::load("test.c0.idx", size, 42, loaded));
+    ASSERT_EQ(loaded.size(), size);
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        ASSERT_EQ(loaded.keys[i], index.keys[i]);
+        ASSERT_EQ(loaded.rowIds[i], index.rowIds[i]);
+    }
+
+    // The index belongs to other data
+    SortedIndex stale;
+    ASSERT_FALSE(SortedIndex::load("test.c0.idx", size, 43, stale));
+    ASSERT_FALSE(SortedIndex::load("test.c0.idx", size + 1, 42, stale));
+    ASSERT_FALSE(SortedIndex::load("missing.c0.idx", size, 42, stale));
+    remove("test.c0.idx");
+}
+//---------------------------------------------------------------------------
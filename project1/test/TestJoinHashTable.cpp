@@ -0,0 +1,233 @@
+#include <cstdint>
+#include <vector>
+#include "JoinHashTable.hpp"
+#include "Operators.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, Probe)
+{
+    // Key (i % 1000) * step for 10000 rows: every key has 10 duplicates
+    const uint64_t size = 10000, step = 1000003;
+    vector<uint64_t> keys(size);
+    for (uint64_t i = 0; i < size; ++i)
+        keys[i] = (i % 1000) * step;
+
+    JoinHashTable<> hashTable;
+    hashTable.build(ColumnView{ keys.data(), nullptr }, size);
+    ASSERT_EQ(hashTable.size(), size);
+    ASSERT_FALSE(hashTable.isDense());
+
+    for (uint64_t k = 0; k < 1000; ++k)
+    {
+        auto range = hashTable.probe(k * step);
+        ASSERT_EQ(range.count, 10u);
+        // The duplicates are adjacent and sorted by row id
+        for (uint64_t j = 0; j < range.count; ++j)
+        {
+            ASSERT_EQ(hashTable[range.offset + j].key, k * step);
+            ASSERT_EQ(hashTable[range.offset + j].rowId, k + 1000 * j);
+        }
+    }
+    for (uint64_t k = 1000; k < 2000; ++k)
+        ASSERT_EQ(hashTable.probe(k * step).count, 0u);
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, Dense)
+{
+    // Keys 500..1499 with 10 duplicates each are direct-addressed
+    const uint64_t size = 10000;
+    vector<uint64_t> keys(size);
+    for (uint64_t i = 0; i < size; ++i)
+        keys[i] = 500 + i % 1000;
+
+    JoinHashTable<> hashTable;
+    hashTable.build(ColumnView{ keys.data(), nullptr }, size);
+    ASSERT_TRUE(hashTable.isDense());
+
+    for (uint64_t key = 500; key < 1500; ++key)
+    {
+        auto range = hashTable.probe(key);
+        ASSERT_EQ(range.count, 10u);
+        for (uint64_t j = 0; j < range.count; ++j)
+        {
+            ASSERT_EQ(hashTable[range.offset + j].key, key);
+            ASSERT_EQ(hashTable[range.offset + j].rowId, key - 500 + 1000 * j);
+        }
+    }
+    // Keys outside of the domain
+    ASSERT_EQ(hashTable.probe(0).count, 0u);
+    ASSERT_EQ(hashTable.probe(499).count, 0u);
+    ASSERT_EQ(hashTable.probe(1500).count, 0u);
+    ASSERT_EQ(hashTable.probe(~0ull).count, 0u);
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, RowIds)
+{
+    // The keys are gathered through row ids, the entries refer to positions
+    vector<uint64_t> base{ 7, 8, 9, 7 };
+    vector<uint64_t> rowIds{ 3, 1, 0 };
+
+    JoinHashTable<> hashTable;
+    hashTable.build(ColumnView{ base.data(), rowIds.data() }, rowIds.size());
+
+    auto range = hashTable.probe(7);
+    ASSERT_EQ(range.count, 2u);
+    ASSERT_EQ(hashTable[range.offset].rowId, 0u);
+    ASSERT_EQ(hashTable[range.offset + 1].rowId, 2u);
+    ASSERT_EQ(hashTable.probe(8).count, 1u);
+    ASSERT_EQ(hashTable.probe(9).count, 0u);
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, GroupProbe)
+{
+    // Many keys without a partner and some with many duplicates, in a dense
+    // and in a sparse domain, in a table that fits into the cache and in one
+    // that is probed with prefetching
+    for (uint64_t step : { 1ull, 1000003ull })
+    {
+        for (uint64_t size : { 5000ull, 100000ull })
+        {
+            vector<uint64_t> keys(size), probeKeys(3 * size + 7);
+            for (uint64_t i = 0; i < size; ++i)
+                keys[i] = (i * 7919) % (size / 4 - 13) * step;
+            for (uint64_t i = 0; i < probeKeys.size(); ++i)
+                probeKeys[i] = i % (size / 2) * step;
+
+            JoinHashTable<> hashTable;
+            hashTable.build(ColumnView{ keys.data(), nullptr }, size);
+            ASSERT_EQ(hashTable.isDense(), step == 1);
+
+            // The group probe finds the same ranges as single probes
+            vector<JoinHashTable<>::Range> ranges(probeKeys.size());
+            hashTable.probe(ColumnView{ probeKeys.data(), nullptr }, 3,
+                            probeKeys.size(), ranges.data());
+            for (uint64_t i = 3; i < probeKeys.size(); ++i)
+            {
+                auto range = hashTable.probe(probeKeys[i]);
+                ASSERT_EQ(ranges[i].count, range.count);
+                if (range.count)
+                {
+                    ASSERT_EQ(ranges[i].offset, range.offset);
+                }
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, NarrowRowIds)
+{
+    static_assert(sizeof(JoinHashTable<uint32_t>::Entry) == 12);
+    static_assert(sizeof(JoinHashTable<uint32_t>::Range) == 8);
+
+    // The 32 bit table finds the same entries as the 64 bit table
+    for (uint64_t step : { 1ull, 1000003ull })
+    {
+        const uint64_t size = 10000;
+        vector<uint64_t> keys(size);
+        for (uint64_t i = 0; i < size; ++i)
+            keys[i] = (i * 7919) % 1237 * step;
+
+        JoinHashTable<uint32_t> narrow;
+        JoinHashTable<uint64_t> wide;
+        narrow.build(ColumnView{ keys.data(), nullptr }, size);
+        wide.build(ColumnView{ keys.data(), nullptr }, size);
+        ASSERT_EQ(narrow.isDense(), step == 1);
+
+        vector<JoinHashTable<uint32_t>::Range> ranges(2000);
+        narrow.probe(ColumnView{ keys.data(), nullptr }, 0, ranges.size(),
+                     ranges.data());
+        for (uint64_t i = 0; i < ranges.size(); ++i)
+        {
+            auto range = wide.probe(keys[i]);
+            ASSERT_EQ(ranges[i].count, range.count);
+            for (uint64_t j = 0; j < range.count; ++j)
+            {
+                ASSERT_EQ(narrow[ranges[i].offset + j].key, keys[i]);
+                ASSERT_EQ(uint64_t(narrow[ranges[i].offset + j].rowId),
+                          wide[range.offset + j].rowId);
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, HeavyHitter)
+{
+    // Most rows have the same key, the build needs several ranges of buckets
+    // and keeps the row ids of every key sorted
+    const uint64_t size = 200000, step = 1000003;
+    vector<uint64_t> keys(size), rowIds(size);
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        keys[i] = i % 10 ? 42 : i * step;
+        rowIds[i] = 3 * i;
+    }
+
+    JoinHashTable<uint32_t> hashTable;
+    hashTable.build(ColumnView{ keys.data(), nullptr }, size, rowIds.data());
+    ASSERT_EQ(hashTable.size(), size);
+
+    auto range = hashTable.probe(42);
+    ASSERT_EQ(range.count, size - size / 10);
+    for (uint64_t j = 1; j < range.count; ++j)
+    {
+        ASSERT_EQ(hashTable[range.offset + j].key, 42u);
+        ASSERT_LT(hashTable[range.offset + j - 1].rowId,
+                  hashTable[range.offset + j].rowId);
+    }
+    for (uint64_t i = 0; i < size; i += 10)
+    {
+        range = hashTable.probe(i * step);
+        ASSERT_EQ(range.count, 1u);
+        ASSERT_EQ(hashTable[range.offset].rowId, 3 * i);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, RemoveDuplicates)
+{
+    // One entry per key is left, numbered by its position
+    for (uint64_t step : { 1ull, 1000003ull })
+    {
+        const uint64_t size = 10000;
+        vector<uint64_t> keys(size);
+        for (uint64_t i = 0; i < size; ++i)
+            keys[i] = (i * 7919) % 1237 * step;
+
+        JoinHashTable<uint32_t> hashTable;
+        hashTable.build(ColumnView{ keys.data(), nullptr }, size);
+        hashTable.removeDuplicates();
+        ASSERT_EQ(hashTable.size(), 1237u);
+        for (uint64_t k = 0; k < 1237; ++k)
+        {
+            auto range = hashTable.probe(k * step);
+            ASSERT_EQ(range.count, 1u);
+            ASSERT_EQ(hashTable[range.offset].key, k * step);
+            ASSERT_EQ(hashTable[range.offset].rowId, range.offset);
+        }
+        ASSERT_EQ(hashTable.probe(1237 * step).count, 0u);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(JoinHashTable, KeyDomain)
+{
+    // Keys 100..1099, a known dense domain is used without scanning the
+    // keys, a wide domain still lets the build find the dense keys
+    const uint64_t size = 5000;
+    vector<uint64_t> keys(size);
+    for (uint64_t i = 0; i < size; ++i)
+        keys[i] = 100 + i % 1000;
+
+    for (auto domain : { JoinHashTable<>::KeyDomain{ 50, 2000 },
+                         JoinHashTable<>::KeyDomain{ 0, ~0ull } })
+    {
+        JoinHashTable<> hashTable;
+        hashTable.build(ColumnView{ keys.data(), nullptr }, size, nullptr,
+                        &domain);
+        ASSERT_TRUE(hashTable.isDense());
+        for (uint64_t key = 0; key < 2100; ++key)
+            ASSERT_EQ(hashTable.probe(key).count,
+                      key >= 100 && key < 1100 ? 5u : 0u);
+    }
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,45 @@
+#include <cstdint>
+#include <vector>
+#include "Materialize.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(Materializer, CountThenScatter)
+{
+    const uint64_t size = 100000;
+
+    // Output 0 gets the multiples of 3, output 1 the multiples of 7
+    Materializer materializer(BlockInfo(0, size), 2);
+    materializer.count([](uint64_t begin, uint64_t end, uint64_t* counts) {
+        counts[0] = counts[1] = 0;
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            counts[0] += i % 3 == 0;
+            counts[1] += i % 7 == 0;
+        }
+    });
+    ASSERT_EQ(materializer.size(0), (size + 2) / 3);
+    ASSERT_EQ(materializer.size(1), (size + 6) / 7);
+
+    vector<uint64_t> multiples3(materializer.size(0));
+    vector<uint64_t> multiples7(materializer.size(1));
+    materializer.scatter(
+        [&](uint64_t begin, uint64_t end, const uint64_t* offsets) {
+            uint64_t offset3 = offsets[0], offset7 = offsets[1];
+            for (uint64_t i = begin; i < end; ++i)
+            {
+                if (i % 3 == 0)
+                    multiples3[offset3++] = i;
+                if (i % 7 == 0)
+                    multiples7[offset7++] = i;
+            }
+        });
+
+    // The tuples are in the order of the loop
+    for (uint64_t i = 0; i < multiples3.size(); ++i)
+        ASSERT_EQ(multiples3[i], 3 * i);
+    for (uint64_t i = 0; i < multiples7.size(); ++i)
+        ASSERT_EQ(multiples7[i], 7 * i);
+}
+//---------------------------------------------------------------------------
@@ -138,6 +138,219 @@ TEST_F(OperatorTest, Join)
     }
 }
 //---------------------------------------------------------------------------
+static Relation createModuloRelation(uint64_t size, uint64_t modulo)
+// Create a relation with the columns (i % modulo, i)
+{
+    auto keys = new uint64_t[size];
+    auto ids = new uint64_t[size];
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        keys[i] = i % modulo;
+        ids[i] = i;
+    }
+    return Relation(size, { keys, ids });
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, RadixJoin)
+{
+    // 100 keys with 200 duplicates on the left and 5 on the right
+    Relation left = createModuloRelation(20000, 100);
+    Relation right = createModuloRelation(5000, 1000);
+
+    vector<vector<uint64_t>> sums;
+    for (auto algorithm : { Join::Algorithm::Hash, Join::Algorithm::Radix })
+    {
+        PredicateInfo pInfo(SelectInfo(0, 0, 0), SelectInfo(1, 1, 0));
+        Join join(make_unique<Scan>(left, 0), make_unique<Scan>(right, 1),
+                  pInfo, algorithm);
+        join.require(SelectInfo(0, 1));
+        join.require(SelectInfo(1, 0));
+        join.require(SelectInfo(1, 1));
+        join.run();
+        ASSERT_EQ(join.resultSize, 100000ull);
+        // The row ids of the small relations are 32 bit wide
+        ASSERT_NE(join.getRowIds(0).narrow, nullptr);
+        ASSERT_NE(join.getRowIds(1).narrow, nullptr);
+
+        auto results = join.getResults();
+        vector<uint64_t> sum(3);
+        for (unsigned j = 0; j < join.resultSize; ++j)
+        {
+            ASSERT_EQ(results[join.resolve(SelectInfo(1, 0))][j] % 100,
+                      results[join.resolve(SelectInfo(0, 1))][j] % 100);
+            sum[0] += results[join.resolve(SelectInfo(0, 1))][j];
+            sum[1] += results[join.resolve(SelectInfo(1, 0))][j];
+            sum[2] += results[join.resolve(SelectInfo(1, 1))][j];
+        }
+        sums.push_back(sum);
+    }
+    ASSERT_EQ(sums[0], sums[1]);
+}
+//---------------------------------------------------------------------------
+static Relation createSortedRelation(uint64_t size, uint64_t duplicates)
+// Create a relation with the columns (i / duplicates, i)
+{
+    auto keys = new uint64_t[size];
+    auto ids = new uint64_t[size];
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        keys[i] = i / duplicates;
+        ids[i] = i;
+    }
+    return Relation(size, { keys, ids });
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinAlgorithms)
+{
+    // Sorted keys with 4 duplicates on the left and 3 on the right
+    Relation right = createSortedRelation(30000, 3);
+    right.collectStatistics();
+    right.buildIndexes();
+
+    // The adaptive join merges the larger left input and looks up the keys
+    // of the smaller one in the index
+    for (uint64_t leftSize : { 2000, 500 })
+    {
+        Relation left = createSortedRelation(leftSize, 4);
+        left.collectStatistics();
+        left.buildIndexes();
+
+        vector<vector<uint64_t>> sums;
+        for (auto algorithm :
+             { Join::Algorithm::Hash, Join::Algorithm::Radix,
+               Join::Algorithm::SortMerge, Join::Algorithm::IndexNestedLoop,
+               Join::Algorithm::Adaptive })
+        {
+            PredicateInfo pInfo(SelectInfo(0, 0, 0), SelectInfo(1, 1, 0));
+            Join join(make_unique<Scan>(left, 0), make_unique<Scan>(right, 1),
+                      pInfo, algorithm);
+            join.require(SelectInfo(0, 1));
+            join.require(SelectInfo(1, 1));
+            join.run();
+            ASSERT_EQ(join.resultSize, leftSize * 3);
+
+            auto results = join.getResults();
+            vector<uint64_t> sum(2);
+            for (unsigned j = 0; j < join.resultSize; ++j)
+            {
+                ASSERT_EQ(results[join.resolve(SelectInfo(0, 1))][j] / 4,
+                          results[join.resolve(SelectInfo(1, 1))][j] / 3);
+                sum[0] += results[join.resolve(SelectInfo(0, 1))][j];
+                sum[1] += results[join.resolve(SelectInfo(1, 1))][j];
+            }
+            sums.push_back(sum);
+        }
+        for (auto& sum : sums)
+            ASSERT_EQ(sum, sums[0]);
+    }
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, SortMergeUnsorted)
+{
+    // A forced sort-merge join on unsorted keys falls back to hashing
+    Relation left = createModuloRelation(20000, 100);
+    Relation right = createModuloRelation(5000, 1000);
+
+    vector<vector<uint64_t>> sums;
+    for (auto algorithm : { Join::Algorithm::Hash, Join::Algorithm::SortMerge })
+    {
+        PredicateInfo pInfo(SelectInfo(0, 0, 0), SelectInfo(1, 1, 0));
+        Join join(make_unique<Scan>(left, 0), make_unique<Scan>(right, 1),
+                  pInfo, algorithm);
+        join.require(SelectInfo(0, 1));
+        join.require(SelectInfo(1, 1));
+        join.run();
+        ASSERT_EQ(join.resultSize, 20000u * 5);
+
+        auto results = join.getResults();
+        vector<uint64_t> sum(2);
+        for (unsigned j = 0; j < join.resultSize; ++j)
+        {
+            ASSERT_EQ(results[join.resolve(SelectInfo(0, 1))][j] % 100,
+                      results[join.resolve(SelectInfo(1, 1))][j] % 1000);
+            sum[0] += results[join.resolve(SelectInfo(0, 1))][j];
+            sum[1] += results[join.resolve(SelectInfo(1, 1))][j];
+        }
+        sums.push_back(sum);
+    }
+    ASSERT_EQ(sums[0], sums[1]);
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, FilterScanIndex)
+{
+    // Column 0 has 1000 distinct values, column 1 is the row id
+    Relation r = createModuloRelation(100000, 1000);
+    vector<vector<FilterInfo>> filterSets{
+        { FilterInfo(SelectInfo(0, 0, 0), 42, FilterInfo::Equal) },
+        { FilterInfo(SelectInfo(0, 0, 0), 5, FilterInfo::Less),
+          FilterInfo(SelectInfo(0, 0, 1), 50000, FilterInfo::Greater) },
+        { FilterInfo(SelectInfo(0, 0, 1), 99990, FilterInfo::Greater),
+          FilterInfo(SelectInfo(0, 0, 0), 995, FilterInfo::Less) },
+        { FilterInfo(SelectInfo(0, 0, 0), 500, FilterInfo::Greater) }
+    };
+
+    // The index lookups find the same rows as the scans
+    vector<vector<uint64_t>> expected;
+    for (bool indexed : { false, true })
+    {
+        if (indexed)
+            r.buildIndexes();
+        for (unsigned s = 0; s < filterSets.size(); ++s)
+        {
+            FilterScan scan(r, filterSets[s]);
+            scan.require(SelectInfo(0, 0, 1));
+            scan.run();
+            auto results = scan.getResults();
+            vector<uint64_t> ids(results[0], results[0] + scan.resultSize);
+            if (!indexed)
+                expected.push_back(ids);
+            else
+                ASSERT_EQ(ids, expected[s]);
+        }
+    }
+    ASSERT_EQ(expected[0].size(), 100u);
+    ASSERT_EQ(expected[1].size(), 249u);
+    ASSERT_EQ(expected[2].size(), 4u);
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, BloomFilterPushdown)
+{
+    // 30 keys on the left, only 30 of the 1000 keys on the right match
+    Relation left = createModuloRelation(300, 30);
+    Relation right = createModuloRelation(5000, 1000);
+    right.collectStatistics();
+
+    for (bool filtered : { false, true })
+    {
+        PredicateInfo pInfo(SelectInfo(0, 0, 0), SelectInfo(1, 1, 0));
+        unique_ptr<Operator> rightScan;
+        if (filtered)
+        {
+            FilterInfo fInfo(SelectInfo(1, 1, 1), 2500, FilterInfo::Less);
+            rightScan = make_unique<FilterScan>(right, fInfo);
+        }
+        else
+        {
+            rightScan = make_unique<Scan>(right, 1);
+        }
+        auto rightScanPtr = rightScan.get();
+        Join join(make_unique<Scan>(left, 0), move(rightScan), pInfo);
+        join.require(SelectInfo(0, 1));
+        join.require(SelectInfo(1, 1));
+        join.run();
+
+        // The right scan only passed on tuples with a partner (and false
+        // positives)
+        ASSERT_LT(rightScanPtr->resultSize, 300u);
+        ASSERT_EQ(join.resultSize, filtered ? 900u : 1500u);
+
+        auto results = join.getResults();
+        for (unsigned j = 0; j < join.resultSize; ++j)
+            ASSERT_EQ(results[join.resolve(SelectInfo(0, 1))][j] % 30,
+                      results[join.resolve(SelectInfo(1, 1))][j] % 1000);
+    }
+}
+//---------------------------------------------------------------------------
 TEST_F(OperatorTest, Checksum)
 {
     unsigned relBinding = 5;
@@ -299,4 +512,160 @@ TEST_F(OperatorTest, Joiner)
     }
 }
 //---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerMaterialized)
+{
+    Joiner joiner;
+    joiner.execution = Joiner::Execution::Materialized;
+    for (unsigned i = 0; i < 3; i++)
+        joiner.relations.push_back(Utils::createRelation(10, 3));
+    for (auto algorithm : { Join::Algorithm::Hash, Join::Algorithm::Radix })
+    {
+        joiner.joinAlgorithm = algorithm;
+        {
+            auto query = "0 1 2|0.0=1.1&1.2=2.0&1.1=4|1.0 2.2";
+            QueryInfo i(query);
+            ASSERT_EQ(joiner.join(i), "4 4\n");
+        }
+        {
+            auto query = "0 1 2|0.0=1.1&1.1=2.0&2.2=0.1|1.0";
+            QueryInfo i(query);
+            ASSERT_EQ(joiner.join(i), "45\n");
+        }
+    }
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerExecutions)
+{
+    // Both engines agree on queries with duplicate keys (fan-out), filters,
+    // cycles and self joins
+    Joiner joiner;
+    joiner.relations.push_back(createModuloRelation(20000, 100));
+    joiner.relations.push_back(createModuloRelation(5000, 1000));
+    joiner.relations.push_back(createModuloRelation(300, 30));
+    joiner.prepare();
+    vector<string> queries{ "0 1|0.0=1.0|0.1 1.1",
+                            "2 1|0.0=1.0&1.1<3000|0.1 1.1",
+                            "0 1 2|0.0=1.0&1.0=2.0&0.1<10000|0.1 1.1 2.1",
+                            "0 1 2|0.0=1.0&1.0=2.0&2.0=0.0&2.1>5|2.1",
+                            "1 1|0.0=1.0&0.1=1.1&0.0=3|0.1",
+                            "2 0 0|0.0=1.0&1.1=2.1&0.0=1.0|0.1 1.0",
+                            "0 1|0.0=1.0&1.0=1000|0.1",
+                            "0 1 2|0.0=1.0&0.0=2.0&2.1<200|1.0 2.1 2.1",
+                            "0 1 2|0.0=1.0&1.0=2.0&1.1=7|0.0 2.0" };
+    for (auto& query : queries)
+    {
+        vector<string> results;
+        for (auto execution :
+             { Joiner::Execution::Materialized, Joiner::Execution::Pipelined,
+               Joiner::Execution::Factorized })
+        {
+            joiner.execution = execution;
+            QueryInfo i(query);
+            results.push_back(joiner.join(i));
+        }
+        ASSERT_EQ(results[0], results[1]) << query;
+        ASSERT_EQ(results[0], results[2]) << query;
+    }
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerCompressed)
+{
+    // Joins over compressed keys get the same results as over the values
+    vector<string> queries{ "0 1|0.0=1.0|0.1 1.1",
+                            "0 1 2|0.0=1.0&1.0=2.0&0.1<10000|0.1 1.1 2.1",
+                            "1 1|0.0=1.0&0.1=1.1&0.0=3|0.1",
+                            "0 1 2|0.0=1.0&0.0=2.0&2.1<200|1.0 2.1 2.1" };
+    vector<vector<string>> results(2);
+    for (bool compression : { false, true })
+    {
+        Joiner joiner;
+        joiner.compression = compression;
+        joiner.relations.push_back(createModuloRelation(20000, 100));
+        joiner.relations.push_back(createModuloRelation(5000, 1000));
+        joiner.relations.push_back(createModuloRelation(300, 30));
+        joiner.prepare();
+        ASSERT_EQ(joiner.relations[0].columns[0] == nullptr, compression);
+        for (auto& query : queries)
+            for (auto execution : { Joiner::Execution::Materialized,
+                                    Joiner::Execution::Pipelined })
+            {
+                joiner.execution = execution;
+                QueryInfo i(query);
+                results[compression].push_back(joiner.join(i));
+            }
+    }
+    ASSERT_EQ(results[0], results[1]);
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerPlanCache)
+{
+    // Repeated queries reuse their plan and get the same results
+    Joiner joiner;
+    joiner.relations.push_back(createModuloRelation(20000, 100));
+    joiner.relations.push_back(createModuloRelation(5000, 1000));
+    joiner.relations.push_back(createModuloRelation(300, 30));
+    joiner.prepare();
+    string query("0 1 2|0.0=1.0&1.0=2.0&0.1<10000|0.1 1.1 2.1");
+    for (auto execution :
+         { Joiner::Execution::Materialized, Joiner::Execution::Pipelined })
+    {
+        joiner.execution = execution;
+        QueryInfo first(query);
+        auto expected = joiner.join(first);
+        auto hits = joiner.planCache.hits.load();
+        for (unsigned run = 0; run < 3; ++run)
+        {
+            QueryInfo i(query);
+            ASSERT_EQ(joiner.join(i), expected);
+        }
+        ASSERT_EQ(joiner.planCache.hits.load(), hits + 3);
+    }
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerFactorized)
+{
+    // 100 keys with 200 tuples each: a three-way self join has 800 million
+    // results, which are only counted
+    Joiner joiner;
+    joiner.relations.push_back(createModuloRelation(20000, 100));
+    QueryInfo i("0 0 0|0.0=1.0&0.0=2.0|0.1 1.1 2.1");
+    uint64_t expected = 0;
+    for (uint64_t key = 0; key < 100; ++key)
+        expected += (200 * key + 100 * 199 * 200 / 2) * 200 * 200;
+    auto sum = to_string(expected);
+    ASSERT_EQ(joiner.join(i), sum + " " + sum + " " + sum + "\n");
+}
+//---------------------------------------------------------------------------
+TEST_F(OperatorTest, JoinerBatch)
+{
+    // Queries that share filters get the same results from shared scans
+    Joiner joiner;
+    joiner.relations.push_back(createModuloRelation(20000, 100));
+    joiner.relations.push_back(createModuloRelation(5000, 1000));
+    joiner.relations.push_back(createModuloRelation(300, 30));
+    joiner.prepare();
+    vector<string> texts{ "0 1|0.0=1.0&0.1<10000|0.1 1.1",
+                          "1 0|0.0=1.0&1.1<10000&0.1>20|0.1 1.1",
+                          "0 1 2|0.0=1.0&1.0=2.0&0.1<10000|2.1",
+                          "2 1|0.0=1.0&1.1>20|0.0" };
+
+    vector<string> expected;
+    joiner.shareResults = false;
+    for (auto& text : texts)
+    {
+        QueryInfo i(text);
+        expected.push_back(joiner.join(i));
+    }
+
+    joiner.shareResults = true;
+    vector<QueryInfo> queries;
+    for (auto& text : texts)
+        queries.emplace_back(text);
+    joiner.prepareBatch(queries);
+    for (unsigned q = 0; q < queries.size(); ++q)
+        ASSERT_EQ(joiner.join(queries[q]), expected[q]) << texts[q];
+    ASSERT_GT(joiner.batchCache.hits, 0u);
+    joiner.endBatch();
+}
+//---------------------------------------------------------------------------
 }  // namespace
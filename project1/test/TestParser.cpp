@@ -168,3 +168,37 @@ TEST(Parser, DumpText)
 
     ASSERT_EQ(i.dumpText(), rawQuery);
 }
+//---------------------------------------------------------------------------
+TEST(Parser, ParseQueryReuse)
+{
+    // A query info is reused for the next query without reallocating
+    QueryInfo i("0 2 4|0.1=1.1&0.0=2.1&1.0=2.0&1.0>3|0.1 1.4 2.2");
+    auto predicates = i.predicates.data();
+    string_view rawQuery("3 1|0.2=1.0&0.1<12|1.1 0.0");
+    i.parseQuery(rawQuery);
+
+    ASSERT_EQ(i.predicates.data(), predicates);
+    ASSERT_EQ(i.relationIds.size(), 2u);
+    ASSERT_EQ(i.relationIds[0], 3u);
+    ASSERT_EQ(i.relationIds[1], 1u);
+    ASSERT_EQ(i.predicates.size(), 1u);
+    assertPredicatEqual(i.predicates[0], 3, 2, 1, 0);
+    ASSERT_EQ(i.filters.size(), 1u);
+    assertFilterEqual(i.filters[0], 3, 1, 12, FilterInfo::Comparison::Less);
+    ASSERT_EQ(i.selections.size(), 2u);
+    assertSelectEqual(i.selections[0], 1, 1);
+    assertSelectEqual(i.selections[1], 3, 0);
+    ASSERT_EQ(i.dumpText(), rawQuery);
+}
+//---------------------------------------------------------------------------
+TEST(Parser, MalformedQuery)
+{
+    ASSERT_DEATH(QueryInfo("0 1|0.1=1.1 0.1|0.1"), "expected '&'");
+    ASSERT_DEATH(QueryInfo("0 1|0.1=1.1&0.1|0.1"), "expected a comparison");
+    ASSERT_DEATH(QueryInfo("0 1|0.1=1.x|0.1"), "expected a number");
+    ASSERT_DEATH(QueryInfo("0 1|0.1=1.1|0.1,1.1"), "expected ' '");
+    ASSERT_DEATH(QueryInfo("0 1|0.1<1.1|0.1"), "expected a constant");
+    ASSERT_DEATH(QueryInfo("0 1|0.1=2.1|0.1"), "Binding 2 does not exist");
+    ASSERT_DEATH(QueryInfo("0 1|99999999999999999999=1|0.1"), "a number");
+    ASSERT_DEATH(QueryInfo("0 1"), "expected '\\|'");
+}
@@ -0,0 +1,52 @@
+#include "Planner.hpp"
+#include "Utils.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+class PlannerTest : public testing::Test
+{
+ protected:
+    vector<Relation> relations;
+
+    void SetUp() override
+    {
+        relations.push_back(Utils::createRelation(1000, 3));
+        relations.push_back(Utils::createRelation(100, 3));
+        relations.push_back(Utils::createRelation(10000, 3));
+        for (auto& r : relations)
+            r.collectStatistics();
+    }
+};
+//---------------------------------------------------------------------------
+TEST_F(PlannerTest, FilterSelectivity)
+{
+    Planner planner(relations);
+    QueryInfo i("0 1 2|0.0=1.0&1.1=2.1&0.1<100&2.2=5|0.0");
+    auto cardinalities = planner.estimateCardinalities(i);
+    ASSERT_EQ(cardinalities.size(), 3u);
+    ASSERT_NEAR(cardinalities[0], 100, 1);
+    ASSERT_NEAR(cardinalities[1], 100, 1);
+    ASSERT_NEAR(cardinalities[2], 1, 1);
+}
+//---------------------------------------------------------------------------
+TEST_F(PlannerTest, OrderJoins)
+{
+    Planner planner(relations);
+    {
+        // The selective filter on binding 2 makes it the first join
+        QueryInfo i("0 1 2|0.0=1.0&1.1=2.1&2.2=5|0.0");
+        planner.orderJoins(i);
+        ASSERT_EQ(i.predicates.size(), 2u);
+        ASSERT_EQ(i.predicates[0].left.binding, 2u);
+        ASSERT_EQ(i.predicates[0].right.binding, 1u);
+        ASSERT_EQ(i.predicates[1].right.binding, 0u);
+    }
+    {
+        // Cyclic queries keep all predicates
+        QueryInfo i("0 1 2|0.0=1.0&1.1=2.1&2.2=0.2|0.0");
+        planner.orderJoins(i);
+        ASSERT_EQ(i.predicates.size(), 3u);
+    }
+}
+//---------------------------------------------------------------------------
@@ -1,4 +1,5 @@
 #include <fstream>
+#include "Joiner.hpp"
 #include "Relation.hpp"
 #include "Utils.hpp"
 #include "gtest/gtest.h"
@@ -38,6 +39,176 @@ TEST(Relation, EmptyRelation)
     ASSERT_RELATION_EQ(r1, r2);
 }
 //---------------------------------------------------------------------------
+TEST(Relation, FormatVersion2)
+{
+    Relation r1 = Utils::createRelation(5000, 3);
+
+    r1.storeRelation("r1");
+    Relation r2("r1");
+
+    ASSERT_RELATION_EQ(r1, r2);
+    // The statistics and zone maps come from the footer
+    ASSERT_EQ(r2.statistics.size(), 3u);
+    ASSERT_EQ(r2.zoneMaps.size(), 3u);
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(r2.columns[c]) % 64, 0u);
+        auto stats = ColumnStatistics::collect(r1.columns[c], r1.size);
+        ASSERT_EQ(r2.statistics[c].min, stats.min);
+        ASSERT_EQ(r2.statistics[c].max, stats.max);
+        ASSERT_EQ(r2.statistics[c].distinct, stats.distinct);
+        ASSERT_EQ(r2.statistics[c].sorted, stats.sorted);
+        ASSERT_EQ(r2.statistics[c].bounds, stats.bounds);
+        ASSERT_EQ(r2.statistics[c].heavyHitters, stats.heavyHitters);
+        auto zoneMap = ZoneMap::build(r1.columns[c], r1.size);
+        ASSERT_EQ(r2.zoneMaps[c].mins, zoneMap.mins);
+        ASSERT_EQ(r2.zoneMaps[c].maxs, zoneMap.maxs);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(Relation, LegacyLayout)
+{
+    Relation r1 = Utils::createRelation(1000, 2);
+
+    std::ofstream outFile("r1", std::ios::binary);
+    uint64_t numColumns = r1.columns.size();
+    outFile.write((char*)&r1.size, sizeof(uint64_t));
+    outFile.write((char*)&numColumns, sizeof(uint64_t));
+    for (auto c : r1.columns)
+        outFile.write((char*)c, r1.size * sizeof(uint64_t));
+    outFile.close();
+    Relation r2("r1");
+
+    ASSERT_RELATION_EQ(r1, r2);
+    ASSERT_TRUE(r2.statistics.empty());
+    ASSERT_EQ(r2.zoneMaps.size(), 2u);
+}
+//---------------------------------------------------------------------------
+TEST(Relation, CorruptFooter)
+{
+    Relation r1 = Utils::createRelation(1000, 2);
+
+    r1.storeRelation("r1");
+    // Flip the last byte of the file, which belongs to the footer
+    std::fstream file("r1", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(-1, std::ios::end);
+    char last = file.get();
+    file.seekp(-1, std::ios::end);
+    file.put(last ^ 1);
+    file.close();
+    Relation r2("r1");
+
+    // The columns are still valid, the zone maps are rebuilt
+    ASSERT_RELATION_EQ(r1, r2);
+    ASSERT_TRUE(r2.statistics.empty());
+    ASSERT_EQ(r2.zoneMaps.size(), 2u);
+}
+//---------------------------------------------------------------------------
+TEST(Relation, OverflowingSize)
+{
+    Relation r1 = Utils::createRelation(1000, 2);
+
+    r1.storeRelation("r1");
+    // Replace the size by one whose column length wraps around to the real
+    // one and recompute the FNV-1a checksum of the header and the segments
+    std::fstream file("r1", std::ios::in | std::ios::out | std::ios::binary);
+    unsigned char header[64 + 2 * 24];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    uint64_t size = (1ull << 61) + r1.size;
+    memcpy(header + 16, &size, sizeof(size));
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned i = 0; i < sizeof(header); ++i)
+        if (i < 56 || i >= 64)
+            hash = (hash ^ header[i]) * 0x100000001b3ull;
+    memcpy(header + 56, &hash, sizeof(hash));
+    file.seekp(0);
+    file.write(reinterpret_cast<char*>(header), sizeof(header));
+    file.close();
+
+    ASSERT_DEATH(Relation("r1"), "invalid segment");
+}
+//---------------------------------------------------------------------------
+static Relation createCompressibleRelation(uint64_t size)
+// Create a relation with the columns (i % 100, i, wide values)
+{
+    auto small = new uint64_t[size];
+    auto ids = new uint64_t[size];
+    auto wide = new uint64_t[size];
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        small[i] = i % 100;
+        ids[i] = i;
+        wide[i] = i * 0x9e3779b97f4a7c15ull;
+    }
+    return Relation(size, { small, ids, wide });
+}
+//---------------------------------------------------------------------------
+TEST(Relation, CompressedSegments)
+{
+    // The wide column has too many distinct values for a dictionary
+    Relation r1 = createCompressibleRelation(70000);
+    Relation original = createCompressibleRelation(70000);
+    r1.collectStatistics();
+    uint64_t rawBytes = r1.memoryUsage();
+    r1.compressColumns();
+
+    // The codes replace the values of the narrow columns
+    ASSERT_EQ(r1.columns[0], nullptr);
+    ASSERT_EQ(r1.columns[1], nullptr);
+    ASSERT_NE(r1.columns[2], nullptr);
+    ASSERT_LT(r1.memoryUsage(), rawBytes);
+
+    // They are stored as compressed segments and mapped back
+    r1.storeRelation("r1");
+    std::ifstream file("r1", std::ios::binary | std::ios::ate);
+    ASSERT_LT(static_cast<uint64_t>(file.tellg()), rawBytes);
+    Relation r2("r1");
+    ASSERT_EQ(r2.columns[0], nullptr);
+    ASSERT_EQ(r2.columns[1], nullptr);
+    ASSERT_EQ(r2.memoryUsage(), r1.memoryUsage());
+    for (unsigned c = 0; c < 3; ++c)
+        for (uint64_t i = 0; i < original.size; ++i)
+            ASSERT_EQ(r2.column(c)[i], original.columns[c][i]);
+}
+//---------------------------------------------------------------------------
+TEST(Relation, CorruptCompressedSegment)
+{
+    Relation r1 = createCompressibleRelation(5000);
+    r1.collectStatistics();
+    r1.compressColumns();
+    r1.storeRelation("r1");
+    // Replace the first code of the first column by one beyond its largest
+    std::fstream file("r1", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t offset;
+    file.seekg(64);
+    file.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+    file.seekp(offset + 32 + r1.compressed[0].dictionary.size() * 8);
+    file.put(static_cast<char>(0xff));
+    file.close();
+
+    ASSERT_DEATH(Relation("r1"), "invalid segment");
+}
+//---------------------------------------------------------------------------
+TEST(Relation, LoadConcurrently)
+{
+    Relation r1 = Utils::createRelation(1000, 2);
+    Relation r2 = Utils::createRelation(300000, 3);
+    r1.storeRelation("r1");
+    r2.storeRelation("r2");
+
+    Joiner joiner;
+    uint64_t bytes = joiner.addRelations({ "r1", "r2", "r1" });
+
+    // The relations keep the order of the file names
+    ASSERT_EQ(joiner.relations.size(), 3u);
+    ASSERT_RELATION_EQ(r1, joiner.relations[0]);
+    ASSERT_RELATION_EQ(r2, joiner.relations[1]);
+    ASSERT_RELATION_EQ(r1, joiner.relations[2]);
+    ASSERT_EQ(bytes, 2 * joiner.relations[0].getFileLength() +
+                         joiner.relations[1].getFileLength());
+    ASSERT_GT(joiner.relations[1].getFileLength(), 300000 * 3 * 8u);
+}
+//---------------------------------------------------------------------------
 TEST(Relation, StoreCsv)
 {
     Relation r1 = Utils::createRelation(1000, 2);
@@ -75,3 +246,17 @@ TEST(Relation, CreateSQL)
     ASSERT_FALSE(std::getline(infile, line));
 }
 //---------------------------------------------------------------------------
+TEST(Relation, Statistics)
+{
+    Relation r1 = Utils::createRelation(100000, 2);
+    r1.collectStatistics();
+
+    ASSERT_EQ(r1.statistics.size(), 2u);
+    for (auto& stats : r1.statistics)
+    {
+        ASSERT_EQ(stats.min, 0u);
+        ASSERT_EQ(stats.max, 99999u);
+        ASSERT_NEAR(stats.distinct, 100000, 5000);
+    }
+}
+//---------------------------------------------------------------------------
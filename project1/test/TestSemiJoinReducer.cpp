@@ -0,0 +1,45 @@
+#include "SemiJoinReducer.hpp"
+#include "Utils.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(SemiJoinReducer, Acyclic)
+{
+    ASSERT_TRUE(SemiJoinReducer::isAcyclic(
+        QueryInfo("0 1 2|0.0=1.0&1.1=2.0|0.0")));
+    // Two predicates between the same relations form a single edge
+    ASSERT_TRUE(SemiJoinReducer::isAcyclic(
+        QueryInfo("0 1 2|0.0=1.0&0.1=1.1&1.0=2.0&2.1<5|0.0")));
+    ASSERT_TRUE(SemiJoinReducer::isAcyclic(
+        QueryInfo("0 1 2 3|0.0=1.0&0.0=2.0&0.0=3.0|0.0")));
+    ASSERT_FALSE(SemiJoinReducer::isAcyclic(
+        QueryInfo("0 1 2|0.0=1.0&1.0=2.0&2.0=0.0|0.0")));
+    ASSERT_FALSE(SemiJoinReducer::isAcyclic(QueryInfo("0 1|0.0=1.0|0.0")));
+}
+//---------------------------------------------------------------------------
+TEST(SemiJoinReducer, Chain)
+{
+    // Every column holds the row ids
+    vector<Relation> relations;
+    for (unsigned i = 0; i < 3; ++i)
+        relations.push_back(Utils::createRelation(10000, 2));
+
+    // Only the rows 0..9 of the first relation find a partner in the last
+    QueryInfo query("0 1 2|0.0=1.0&1.1=2.0&2.0<10|0.0");
+    SemiJoinReducer reducer(relations, query);
+    ASSERT_TRUE(reducer.run());
+    ASSERT_EQ(reducer.rowIds.size(), 3u);
+    for (auto& rowIds : reducer.rowIds)
+    {
+        ASSERT_TRUE(rowIds);
+        ASSERT_TRUE(rowIds->isNarrow());
+        // A few false positives of the Bloom filters may remain
+        ASSERT_GE(rowIds->size(), 10u);
+        ASSERT_LT(rowIds->size(), 100u);
+        for (uint64_t i = 0; i < 10; ++i)
+            ASSERT_EQ(rowIds->view()[i], i);
+    }
+    ASSERT_EQ(reducer.rowIds[2]->size(), 10u);
+}
+//---------------------------------------------------------------------------
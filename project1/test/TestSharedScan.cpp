@@ -0,0 +1,45 @@
+#include "FilterKernels.hpp"
+#include "SharedScan.hpp"
+#include "Utils.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(SharedScan, FilterSets)
+{
+    Relation r = Utils::createRelation(10000, 2);
+    vector<vector<FilterInfo>> filterSets(3);
+    filterSets[0].emplace_back(SelectInfo(0, 0, 0), 5000, FilterInfo::Less);
+    filterSets[1].emplace_back(SelectInfo(0, 0, 1), 9000, FilterInfo::Greater);
+    filterSets[1].emplace_back(SelectInfo(0, 0, 0), 9500, FilterInfo::Less);
+    filterSets[2].emplace_back(SelectInfo(0, 0, 0), 42, FilterInfo::Equal);
+
+    SharedScan scan(r, filterSets);
+    scan.run();
+    ASSERT_EQ(scan.results.size(), 3u);
+
+    // Each filter set gets the same row ids as a scan of its own
+    for (unsigned s = 0; s < 3; ++s)
+    {
+        vector<uint64_t> expected;
+        uint64_t selection[FilterKernels::selectionSize];
+        for (uint64_t i = 0; i < r.size; i += FilterKernels::blockSize)
+        {
+            uint64_t end = min<uint64_t>(r.size, i + FilterKernels::blockSize);
+            unsigned n =
+                FilterKernels::select(r, filterSets[s], i, end, selection);
+            expected.insert(expected.end(), selection, selection + n);
+        }
+        // The row ids of the small relation are 32 bit wide
+        ASSERT_TRUE(scan.results[s].isNarrow());
+        ASSERT_EQ(scan.results[s].size(), expected.size());
+        auto rowIds = scan.results[s].view();
+        for (uint64_t i = 0; i < expected.size(); ++i)
+            ASSERT_EQ(rowIds[i], expected[i]);
+    }
+    ASSERT_EQ(scan.results[0].size(), 5000u);
+    ASSERT_EQ(scan.results[1].size(), 499u);
+    ASSERT_EQ(scan.results[2].size(), 1u);
+    ASSERT_EQ(scan.results[2].view()[0], 42u);
+}
+//---------------------------------------------------------------------------
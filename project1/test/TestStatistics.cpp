@@ -0,0 +1,91 @@
+#include "Statistics.hpp"
+#include "Utils.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(Statistics, HyperLogLog)
+{
+    for (uint64_t n : { 10ull, 1000ull, 100000ull })
+    {
+        HyperLogLog sketch, other;
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            sketch.add(i);
+            // Duplicates do not change the estimate
+            sketch.add(i);
+            other.add(i + n);
+        }
+        ASSERT_NEAR(sketch.estimate(), n, n * 0.05 + 1);
+
+        sketch.merge(other);
+        ASSERT_NEAR(sketch.estimate(), 2 * n, n * 0.1 + 1);
+    }
+}
+//---------------------------------------------------------------------------
+TEST(Statistics, UniformColumn)
+{
+    Relation r = Utils::createRelation(100000, 1);
+    auto stats = ColumnStatistics::collect(r.columns[0], r.size);
+
+    ASSERT_EQ(stats.min, 0u);
+    ASSERT_EQ(stats.max, 99999u);
+    ASSERT_NEAR(stats.distinct, 100000, 5000);
+    ASSERT_TRUE(stats.heavyHitters.empty());
+
+    ASSERT_EQ(stats.estimateLess(0), 0);
+    ASSERT_NEAR(stats.estimateLess(25000), 0.25, 0.01);
+    ASSERT_NEAR(stats.estimateGreater(90000), 0.1, 0.01);
+    ASSERT_EQ(stats.estimateGreater(99999), 0);
+    ASSERT_NEAR(stats.estimateEqual(42), 1e-5, 1e-6);
+    ASSERT_EQ(stats.estimateEqual(100000), 0);
+}
+//---------------------------------------------------------------------------
+TEST(Statistics, SkewedColumn)
+{
+    // Half of the values are 7, the rest is unique
+    const uint64_t size = 10000;
+    vector<uint64_t> column(size);
+    for (uint64_t i = 0; i < size; ++i)
+        column[i] = i % 2 ? 7 : 1000 + i;
+    auto stats = ColumnStatistics::collect(column.data(), size);
+
+    ASSERT_EQ(stats.heavyHitters.size(), 1u);
+    ASSERT_EQ(stats.heavyHitters[0].first, 7u);
+    ASSERT_NEAR(stats.estimateEqual(7), 0.5, 0.01);
+    ASSERT_NEAR(stats.estimateEqual(1002), 1.0 / size, 1e-4);
+    ASSERT_NEAR(stats.estimateLess(1000), 0.5, 0.02);
+}
+//---------------------------------------------------------------------------
+TEST(Statistics, ZoneMap)
+{
+    Relation r = Utils::createRelation(5000, 1);
+    auto zoneMap = ZoneMap::build(r.columns[0], r.size);
+
+    ASSERT_EQ(zoneMap.mins.size(), 5u);
+    ASSERT_EQ(zoneMap.mins[1], 1024u);
+    ASSERT_EQ(zoneMap.maxs[1], 2047u);
+    ASSERT_EQ(zoneMap.maxs[4], 4999u);
+
+    ASSERT_EQ(zoneMap.matchLess(1, 1024), ZoneMap::Match::None);
+    ASSERT_EQ(zoneMap.matchLess(1, 1500), ZoneMap::Match::Some);
+    ASSERT_EQ(zoneMap.matchLess(1, 2048), ZoneMap::Match::All);
+    ASSERT_EQ(zoneMap.matchGreater(1, 2047), ZoneMap::Match::None);
+    ASSERT_EQ(zoneMap.matchGreater(1, 1023), ZoneMap::Match::All);
+    ASSERT_EQ(zoneMap.matchEqual(1, 3000), ZoneMap::Match::None);
+    ASSERT_EQ(zoneMap.matchEqual(1, 1500), ZoneMap::Match::Some);
+}
+//---------------------------------------------------------------------------
+TEST(Statistics, Sorted)
+{
+    vector<uint64_t> column(10000);
+    for (uint64_t i = 0; i < column.size(); ++i)
+        column[i] = i / 3;
+    ASSERT_TRUE(ColumnStatistics::collect(column.data(), column.size()).sorted);
+
+    // A single value out of order at the end
+    column.back() = 0;
+    ASSERT_FALSE(
+        ColumnStatistics::collect(column.data(), column.size()).sorted);
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,77 @@
+#include <atomic>
+#include <numeric>
+#include "ThreadPool.hpp"
+#include "gtest/gtest.h"
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+TEST(ThreadPool, Submit)
+{
+    ThreadPool pool(4);
+    atomic<unsigned> counter = 0;
+    vector<TaskFuture> futures;
+    for (unsigned i = 0; i < 1000; ++i)
+        futures.push_back(pool.Submit([&counter](unsigned v) { counter += v; },
+                                      i));
+    for (auto& future : futures)
+        future.wait();
+    ASSERT_EQ(counter.load(), 999u * 1000 / 2);
+}
+//---------------------------------------------------------------------------
+TEST(ThreadPool, ParallelFor)
+{
+    ThreadPool pool(4);
+    vector<uint64_t> values(100000);
+    BlockInfo bi = BlockInfo::Morsels(0, values.size(), 1000);
+    vector<unsigned> ranks(bi.blockCount);
+    pool.ParallelFor(bi, [&values, &ranks](unsigned rank, uint64_t begin,
+                                           uint64_t end) {
+        ++ranks[rank];
+        for (uint64_t i = begin; i < end; ++i)
+            values[i] = i;
+    });
+    // Every block ran exactly once
+    for (auto r : ranks)
+        ASSERT_EQ(r, 1u);
+    ASSERT_EQ(accumulate(values.begin(), values.end(), 0ull),
+              99999ull * 100000 / 2);
+}
+//---------------------------------------------------------------------------
+TEST(ThreadPool, NestedParallelFor)
+{
+    // Workers wait for nested loops by running tasks instead of blocking
+    ThreadPool pool(4);
+    atomic<uint64_t> sum = 0;
+    vector<TaskFuture> futures;
+    for (unsigned q = 0; q < 16; ++q)
+    {
+        futures.push_back(pool.Submit([&pool, &sum]() {
+            BlockInfo outer = BlockInfo::Morsels(0, 64, 1);
+            pool.ParallelFor(outer, [&pool, &sum](unsigned, uint64_t,
+                                                  uint64_t) {
+                BlockInfo inner = BlockInfo::Morsels(0, 64, 1);
+                pool.ParallelFor(inner, [&sum](unsigned, uint64_t begin,
+                                               uint64_t end) {
+                    sum += end - begin;
+                });
+            });
+        }));
+    }
+    for (auto& future : futures)
+        future.wait();
+    ASSERT_EQ(sum.load(), 16u * 64 * 64);
+}
+//---------------------------------------------------------------------------
+TEST(ThreadPool, Priorities)
+{
+    // Without workers, the waiting thread runs the most urgent tasks first
+    ThreadPool pool(0);
+    vector<unsigned> order;
+    vector<TaskFuture> futures;
+    for (unsigned priority : { 3, 1, 2 })
+        futures.push_back(pool.SubmitWithPriority(
+            priority, [&order, priority]() { order.push_back(priority); }));
+    pool.Wait(futures[0]);
+    ASSERT_EQ(order, (vector<unsigned>{ 1, 2, 3 }));
+}
+//---------------------------------------------------------------------------
@@ -1,7 +1,11 @@
+#include "ThreadPool.hpp"
 #include "gtest/gtest.h"
 //---------------------------------------------------------------------------
 int main(int argc, char** argv)
 {
+    ThreadPool pool;
+    pool.SetAsMainPool();
+
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }